@@ -0,0 +1,128 @@
+#include <cmath>
+
+#include "CheckpointCache.h"
+
+#define BOX_TOLERANCE 1e-3f // px and degrees a box may differ from the saved one
+
+CheckpointCache::CheckpointCache(size_t capacity)
+:
+capacity(capacity),
+used(0)
+{
+}
+
+/*
+* Limits the memory of all states, older states are dropped right away if necessary. 0 disables the cache.
+*/
+void CheckpointCache::setCapacity(size_t bytes)
+{
+	capacity = bytes;
+	if (capacity == 0) clear();
+	else evict();
+}
+
+void CheckpointCache::clear()
+{
+	checkpoints.clear();
+	index.clear();
+	used = 0;
+}
+
+/*
+* Saves the state of tracker after it tracked object at frame, box is the result of that frame.
+* The buffers of a replaced or dropped state are reused.
+*/
+void CheckpointCache::save(size_t object, size_t frame, const FlowBox &box, const OFTracker &tracker)
+{
+	if (capacity == 0) return;
+
+	Key key(frame, object);
+	std::map<Key, std::list<Checkpoint>::iterator>::iterator it = index.find(key);
+	if (it != index.end())
+	{
+		checkpoints.splice(checkpoints.begin(), checkpoints, it->second);
+		used -= checkpoints.front().bytes;
+	}
+	else
+	{
+		if (!checkpoints.empty() && used >= capacity)
+		{
+			// recycle the least recently used one
+			checkpoints.splice(checkpoints.begin(), checkpoints, --checkpoints.end());
+			index.erase(checkpoints.front().key);
+			used -= checkpoints.front().bytes;
+		}
+		else
+		{
+			checkpoints.push_front(Checkpoint());
+		}
+		index[key] = checkpoints.begin();
+	}
+
+	Checkpoint &checkpoint = checkpoints.front();
+	checkpoint.key = key;
+	checkpoint.box = box;
+	tracker.saveState(checkpoint.state);
+	checkpoint.bytes = checkpoint.state.bytes();
+	used += checkpoint.bytes;
+
+	evict();
+}
+
+/*
+* Continues tracker from the state of object at frame if there is one and box is still the box of that frame
+*/
+bool CheckpointCache::restore(size_t object, size_t frame, const FlowBox &box, OFTracker &tracker)
+{
+	std::map<Key, std::list<Checkpoint>::iterator>::iterator it = index.find(Key(frame, object));
+	if (it == index.end()) return false;
+
+	Checkpoint &checkpoint = *it->second;
+	if (!sameBox(checkpoint.box, box) || !tracker.restoreState(checkpoint.state))
+	{
+		// the box was edited since, the state is of no use anymore
+		used -= checkpoint.bytes;
+		checkpoints.erase(it->second);
+		index.erase(it);
+		return false;
+	}
+
+	checkpoints.splice(checkpoints.begin(), checkpoints, it->second);
+	return true;
+}
+
+bool CheckpointCache::contains(size_t object, size_t frame) const
+{
+	return index.count(Key(frame, object)) > 0;
+}
+
+size_t CheckpointCache::size() const
+{
+	return checkpoints.size();
+}
+
+size_t CheckpointCache::bytes() const
+{
+	return used;
+}
+
+/*
+* Drops the least recently used states until they fit in the capacity, the most recent one is always kept
+*/
+void CheckpointCache::evict()
+{
+	while (used > capacity && checkpoints.size() > 1)
+	{
+		Checkpoint &checkpoint = checkpoints.back();
+		used -= checkpoint.bytes;
+		index.erase(checkpoint.key);
+		checkpoints.pop_back();
+	}
+}
+
+bool CheckpointCache::sameBox(const FlowBox &a, const FlowBox &b)
+{
+	return std::abs(a.x - b.x) < BOX_TOLERANCE && std::abs(a.y - b.y) < BOX_TOLERANCE &&
+		std::abs(a.w - b.w) < BOX_TOLERANCE && std::abs(a.h - b.h) < BOX_TOLERANCE &&
+		std::abs(a.phi - b.phi) < BOX_TOLERANCE;
+}
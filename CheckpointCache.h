@@ -0,0 +1,44 @@
+#pragma once
+
+#include <list>
+#include <map>
+
+#include "FlowBox.h"
+#include "OFTracker.h"
+
+/*
+* Least recently used tracker states by frame and object, limited to a number of bytes.
+* Resuming at a cached frame restores the tracker instead of initialising it again.
+* A state is only restored for the object and while the box it was saved with is unchanged.
+*/
+class CheckpointCache
+{
+	typedef std::pair<size_t, size_t> Key; // frame, object
+
+	struct Checkpoint
+	{
+		Key key;
+		FlowBox box; // box the tracker had at frame
+		TrackerState state;
+		size_t bytes;
+	};
+
+	std::list<Checkpoint> checkpoints; // most recently used first
+	std::map<Key, std::list<Checkpoint>::iterator> index;
+	size_t capacity; // bytes
+	size_t used; // bytes
+
+public:
+	CheckpointCache(size_t capacity);
+	void setCapacity(size_t bytes);
+	void clear();
+	void save(size_t object, size_t frame, const FlowBox &box, const OFTracker &tracker);
+	bool restore(size_t object, size_t frame, const FlowBox &box, OFTracker &tracker);
+	bool contains(size_t object, size_t frame) const;
+	size_t size() const;
+	size_t bytes() const;
+
+private:
+	void evict();
+	static bool sameBox(const FlowBox &a, const FlowBox &b);
+};
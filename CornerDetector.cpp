@@ -0,0 +1,215 @@
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "CornerDetector.h"
+
+#define GRID_CELL_SIZE 48 // px, detection runs per cell of this size and in parallel
+#define SUBPIX_WINDOW 10
+#define SUBPIX_ITERATIONS 40
+#define CELL_SUBPIX_WINDOW 5 // smaller sub-pixel refinement for grid detection
+#define CELL_SUBPIX_ITERATIONS 10
+
+/*
+* Detects features in each cell of a grid over the region of interest.
+*/
+class CellDetection : public cv::ParallelLoopBody
+{
+	CornerDetector *detector;
+	const cv::Mat &image, &mask;
+	const std::vector<cv::Rect> &cells;
+	const std::vector<int> &quotas;
+	std::vector<Points> &found;
+
+public:
+	CellDetection(CornerDetector *detector, const cv::Mat &image, const cv::Mat &mask, const std::vector<cv::Rect> &cells,
+		const std::vector<int> &quotas, std::vector<Points> &found)
+	: detector(detector), image(image), mask(mask), cells(cells), quotas(quotas), found(found) {}
+
+	void operator()(const cv::Range &range) const override
+	{
+		cv::TermCriteria crit(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, CELL_SUBPIX_ITERATIONS, 0.03);
+
+		for (int c = range.start; c < range.end; c++)
+		{
+			Points &points = found[c];
+			points.clear();
+			if (quotas[c] <= 0) continue;
+
+			cv::Mat cell_mask;
+			if (!mask.empty()) cell_mask = mask(cells[c]);
+
+			detector->detect(image(cells[c]), points, cell_mask, quotas[c]);
+
+			for (int i = 0; i < static_cast<int>(points.size()); i++)
+				points[i] += cv::Point2f(static_cast<float>(cells[c].x), static_cast<float>(cells[c].y));
+
+			if (detector->subpixel && !points.empty())
+				cv::cornerSubPix(image, points, cv::Size(CELL_SUBPIX_WINDOW, CELL_SUBPIX_WINDOW), cv::Size(-1,-1), crit);
+		}
+	}
+};
+
+CornerDetector::CornerDetector()
+:
+subpixel(true)
+{
+}
+
+CornerDetector::~CornerDetector()
+{
+}
+
+void CornerDetector::setSubPixel(bool enabled)
+{
+	subpixel = enabled;
+}
+
+/*
+* Shares the corner response of map, if the detector supports it
+*/
+void CornerDetector::setFeatureMap(FeatureMap *)
+{
+}
+
+/*
+* Called before the detection in roi of image starts
+*/
+void CornerDetector::prepare(const cv::Mat &, const cv::Mat &, const cv::Rect &)
+{
+}
+
+/*
+* Detects up to max_count features within roi.
+* Regions larger than one grid cell are split into cells that are searched in parallel,
+* each for its share of the features. This spreads the features evenly and avoids
+* sorting and refining the corners of the whole region at once.
+*/
+void CornerDetector::detectInRegion(const cv::Mat &image, Points &points, const cv::Mat &msk, const cv::Rect &roi, int max_count)
+{
+	points.clear();
+	if (roi.area() == 0 || max_count <= 0) return;
+
+	prepare(image, msk, roi);
+
+	int cols = (roi.width + GRID_CELL_SIZE - 1) / GRID_CELL_SIZE;
+	int rows = (roi.height + GRID_CELL_SIZE - 1) / GRID_CELL_SIZE;
+
+	if (cols * rows == 1)
+	{
+		cv::Mat roi_mask;
+		if (!msk.empty()) roi_mask = msk(roi);
+
+		detect(image(roi), points, roi_mask, max_count);
+
+		for (int i = 0; i < static_cast<int>(points.size()); i++)
+			points[i] += cv::Point2f(static_cast<float>(roi.x), static_cast<float>(roi.y));
+
+		if (!subpixel || points.size() == 0) return;
+	
+		cv::TermCriteria crit(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, SUBPIX_ITERATIONS, 0.03);
+		cv::cornerSubPix(image, points, cv::Size(SUBPIX_WINDOW, SUBPIX_WINDOW), cv::Size(-1,-1), crit);
+		return;
+	}
+
+	std::vector<cv::Rect> cells(cols * rows);
+	std::vector<int> areas(cols * rows), quotas(cols * rows);
+	int total = 0;
+
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < cols; c++)
+		{
+			int i = r * cols + c;
+			cells[i] = cv::Rect(roi.x + c * GRID_CELL_SIZE, roi.y + r * GRID_CELL_SIZE, GRID_CELL_SIZE, GRID_CELL_SIZE) & roi;
+			areas[i] = msk.empty() ? cells[i].area() : cv::countNonZero(msk(cells[i]));
+			total += areas[i];
+		}
+	}
+
+	if (!total) return;
+
+	// cumulative rounding hands out exactly max_count features
+	int64 cumulated = 0;
+	for (int i = 0; i < cols * rows; i++)
+	{
+		int before = static_cast<int>(cumulated * max_count / total);
+		cumulated += areas[i];
+		quotas[i] = static_cast<int>(cumulated * max_count / total) - before;
+	}
+
+	std::vector<Points> found(cols * rows);
+	cv::parallel_for_(cv::Range(0, cols * rows), CellDetection(this, image, msk, cells, quotas, found));
+
+	for (int i = 0; i < cols * rows; i++)
+		points.insert(points.end(), found[i].begin(), found[i].end());
+}
+
+ShiTomasiDetector::ShiTomasiDetector(double quality, double min_distance)
+:
+quality(quality),
+min_distance(min_distance),
+features(NULL),
+threshold(0)
+{
+}
+
+void ShiTomasiDetector::setFeatureMap(FeatureMap *map)
+{
+	features = map;
+}
+
+/*
+* Response of roi and the threshold of the quality level for all cells of it.
+* A threshold per cell would let cells without texture return their noise as corners.
+*/
+void ShiTomasiDetector::prepare(const cv::Mat &image, const cv::Mat &msk, const cv::Rect &roi)
+{
+	if (features) features->cover(image, roi);
+
+	cv::Mat region = image(roi);
+	if (!features || !features->response(region, response))
+		cv::cornerMinEigenVal(region, response, 3, 3);
+
+	cv::Size whole;
+	region.locateROI(whole, origin);
+
+	double max_value;
+	cv::minMaxLoc(response, 0, &max_value, 0, 0, msk.empty() ? cv::Mat() : msk(roi));
+	threshold = static_cast<float>(max_value * quality);
+}
+
+void ShiTomasiDetector::detect(const cv::Mat &image, Points &points, const cv::Mat &msk, int max_count)
+{
+	cv::Size whole;
+	cv::Point ofs;
+	image.locateROI(whole, ofs);
+
+	cv::Mat eig = response(cv::Rect(ofs.x - origin.x, ofs.y - origin.y, image.cols, image.rows));
+	FeatureMap::select(eig, msk, points, max_count, threshold, min_distance);
+}
+
+FastDetector::FastDetector(int threshold)
+:
+threshold(threshold)
+{
+	subpixel = false;
+}
+
+void FastDetector::detect(const cv::Mat &image, Points &points, const cv::Mat &msk, int max_count)
+{
+	std::vector<cv::KeyPoint> keypoints;
+
+	cv::FAST(image, keypoints, threshold, true);
+	if (!msk.empty()) cv::KeyPointsFilter::runByPixelsMask(keypoints, msk);
+	cv::KeyPointsFilter::retainBest(keypoints, max_count);
+
+	points.resize(keypoints.size());
+	for (int i = 0; i < static_cast<int>(keypoints.size()); i++)
+		points[i] = keypoints[i].pt;
+}
+
+CornerDetector * createCornerDetector(int type)
+{
+	if (type == DETECTOR_FAST) return new FastDetector();
+	return new ShiTomasiDetector();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "FeatureMap.h"
+#include "RigidTransform.h"
+
+#define DETECTOR_SHI_TOMASI 0
+#define DETECTOR_FAST 1
+
+/*
+* Strategy for the detection of trackable corners.
+* detectInRegion() spreads the search over a grid of cells that are searched in parallel,
+* each for its share of the features, and refines the result to sub-pixel accuracy if enabled.
+* Implementations only detect the strongest corners of one cell.
+*/
+class CornerDetector
+{
+	friend class CellDetection;
+
+protected:
+	bool subpixel;
+
+public:
+	CornerDetector();
+	virtual ~CornerDetector();
+	void setSubPixel(bool enabled);
+	virtual void setFeatureMap(FeatureMap *map);
+	void detectInRegion(const cv::Mat &image, Points &points, const cv::Mat &msk, const cv::Rect &roi, int max_count);
+
+protected:
+	virtual void prepare(const cv::Mat &image, const cv::Mat &msk, const cv::Rect &roi);
+	virtual void detect(const cv::Mat &image, Points &points, const cv::Mat &msk, int max_count) = 0;
+};
+
+/*
+* Shi-Tomasi corners (minimal eigenvalue) like goodFeaturesToTrack.
+* The response of the region is computed once, or taken from a FeatureMap if the image belongs to it,
+* and the quality level is relative to the strongest corner of the whole region, not of each cell.
+*/
+class ShiTomasiDetector : public CornerDetector
+{
+	double quality;
+	double min_distance;
+	FeatureMap *features;
+	cv::Mat response; // of the region searched by detectInRegion()
+	cv::Point origin; // of response in the underlying image
+	float threshold;
+
+public:
+	ShiTomasiDetector(double quality = 0.01, double min_distance = 3);
+	virtual void setFeatureMap(FeatureMap *map) override;
+
+protected:
+	virtual void prepare(const cv::Mat &image, const cv::Mat &msk, const cv::Rect &roi) override;
+	virtual void detect(const cv::Mat &image, Points &points, const cv::Mat &msk, int max_count) override;
+};
+
+/*
+* FAST corners with non-maximum suppression, the strongest responses are kept.
+* Much cheaper than Shi-Tomasi, pixel accurate unless sub-pixel refinement is enabled.
+*/
+class FastDetector : public CornerDetector
+{
+	int threshold;
+
+public:
+	FastDetector(int threshold = 20);
+
+protected:
+	virtual void detect(const cv::Mat &image, Points &points, const cv::Mat &msk, int max_count) override;
+};
+
+CornerDetector * createCornerDetector(int type);
@@ -0,0 +1,187 @@
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "FeatureMap.h"
+
+#define TILE_SIZE 64 // px
+#define BLOCK_SIZE 3 // neighbourhood of the corner response
+#define APERTURE_SIZE 3 // of the Sobel operator
+#define TILE_MARGIN (BLOCK_SIZE / 2 + 1) // px a tile needs around it to match the response of the whole image
+
+/*
+* Computes the corner response of a list of tiles
+*/
+class TileResponse : public cv::ParallelLoopBody
+{
+	const cv::Mat &gray;
+	cv::Mat &response;
+	const std::vector<cv::Rect> &tiles;
+
+public:
+	TileResponse(const cv::Mat &gray, cv::Mat &response, const std::vector<cv::Rect> &tiles)
+	: gray(gray), response(response), tiles(tiles) {}
+
+	void operator()(const cv::Range &range) const override
+	{
+		cv::Rect frame(0, 0, gray.cols, gray.rows);
+		cv::Mat eig;
+
+		for (int t = range.start; t < range.end; t++)
+		{
+			// the block filter of cornerMinEigenVal treats the border of its input as image border,
+			// so every tile is computed with a margin and only its inner part is kept
+			const cv::Rect &tile = tiles[t];
+			cv::Rect outer = cv::Rect(tile.x - TILE_MARGIN, tile.y - TILE_MARGIN, tile.width + 2 * TILE_MARGIN, tile.height + 2 * TILE_MARGIN) & frame;
+
+			cv::cornerMinEigenVal(gray(outer), eig, BLOCK_SIZE, APERTURE_SIZE);
+
+			cv::Mat dst = response(tile);
+			eig(cv::Rect(tile.x - outer.x, tile.y - outer.y, tile.width, tile.height)).copyTo(dst);
+		}
+	}
+};
+
+FeatureMap::FeatureMap()
+:
+current(0),
+cols(0),
+rows(0)
+{
+}
+
+/*
+* Makes frame the current frame, the current one becomes the previous one.
+* Trackers that share the map take their gray image from it.
+*/
+void FeatureMap::setFrame(const cv::Mat &frame)
+{
+	current = !current;
+	Level &level = levels[current];
+
+	// new buffers, trackers may still hold the old ones
+	level.gray = cv::Mat();
+	level.response = cv::Mat(frame.size(), CV_32F);
+	cv::cvtColor(frame, level.gray, CV_BGR2GRAY);
+
+	cols = (frame.cols + TILE_SIZE - 1) / TILE_SIZE;
+	rows = (frame.rows + TILE_SIZE - 1) / TILE_SIZE;
+	level.computed.assign(cols * rows, 0);
+
+	if (levels[!current].gray.size() != frame.size()) levels[!current] = Level();
+}
+
+const cv::Mat & FeatureMap::gray() const
+{
+	return levels[current].gray;
+}
+
+/*
+* Computes the response of all tiles of roi that aren't computed yet.
+* image must be the whole gray image of one of the frames of the map, otherwise nothing happens.
+*/
+void FeatureMap::cover(const cv::Mat &image, const cv::Rect &roi)
+{
+	Level *level = const_cast<Level*>(levelOf(image));
+	if (!level || roi.area() == 0) return;
+
+	std::vector<cv::Rect> tiles;
+	cv::Rect frame(0, 0, level->gray.cols, level->gray.rows);
+
+	for (int r = roi.y / TILE_SIZE; r <= (roi.y + roi.height - 1) / TILE_SIZE && r < rows; r++)
+	{
+		for (int c = roi.x / TILE_SIZE; c <= (roi.x + roi.width - 1) / TILE_SIZE && c < cols; c++)
+		{
+			if (level->computed[r * cols + c]) continue;
+
+			tiles.push_back(cv::Rect(c * TILE_SIZE, r * TILE_SIZE, TILE_SIZE, TILE_SIZE) & frame);
+			level->computed[r * cols + c] = 1;
+		}
+	}
+
+	if (!tiles.empty())
+		cv::parallel_for_(cv::Range(0, static_cast<int>(tiles.size())), TileResponse(level->gray, level->response, tiles));
+}
+
+/*
+* Shared response of image, which may be a part of a gray image of the map, its area must be covered.
+* Returns false if image doesn't belong to the map.
+*/
+bool FeatureMap::response(const cv::Mat &image, cv::Mat &eig) const
+{
+	const Level *level = levelOf(image);
+	if (!level) return false;
+
+	cv::Size whole;
+	cv::Point ofs;
+	image.locateROI(whole, ofs);
+	eig = level->response(cv::Rect(ofs.x, ofs.y, image.cols, image.rows));
+
+	return true;
+}
+
+/*
+* Selects up to max_count corners from a corner response like goodFeaturesToTrack,
+* but with an absolute threshold instead of a quality level relative to the maximum of eig.
+*/
+void FeatureMap::select(const cv::Mat &eig, const cv::Mat &msk, Points &points, int max_count, float threshold, double min_distance)
+{
+	points.clear();
+	if (threshold <= 0) return;
+
+	// 3x3 local maxima above the threshold, the neighbourhood is clipped to eig
+	// as the response around it may not be computed
+	std::vector<std::pair<float, cv::Point> > corners;
+	for (int y = 0; y < eig.rows; y++)
+	{
+		const float *e = eig.ptr<float>(y);
+		const uchar *m = msk.empty() ? 0 : msk.ptr<uchar>(y);
+
+		for (int x = 0; x < eig.cols; x++)
+		{
+			if (e[x] < threshold || (m && !m[x])) continue;
+
+			bool maximum = true;
+			for (int v = std::max(y - 1, 0); v <= std::min(y + 1, eig.rows - 1) && maximum; v++)
+			{
+				const float *n = eig.ptr<float>(v);
+				for (int u = std::max(x - 1, 0); u <= std::min(x + 1, eig.cols - 1) && maximum; u++)
+					maximum = n[u] <= e[x];
+			}
+
+			if (maximum) corners.push_back(std::make_pair(e[x], cv::Point(x, y)));
+		}
+	}
+
+	std::sort(corners.begin(), corners.end(),
+		[](const std::pair<float, cv::Point> &a, const std::pair<float, cv::Point> &b) { return a.first > b.first; });
+
+	float min_distance2 = static_cast<float>(min_distance * min_distance);
+	for (int i = 0; i < static_cast<int>(corners.size()) && static_cast<int>(points.size()) < max_count; i++)
+	{
+		cv::Point2f p(static_cast<float>(corners[i].second.x), static_cast<float>(corners[i].second.y));
+
+		bool free = true;
+		for (int j = 0; j < static_cast<int>(points.size()) && free; j++)
+		{
+			cv::Point2f d = points[j] - p;
+			free = d.x * d.x + d.y * d.y >= min_distance2;
+		}
+
+		if (free) points.push_back(p);
+	}
+}
+
+/*
+* Finds the frame image belongs to, image may be a part of it
+*/
+const FeatureMap::Level * FeatureMap::levelOf(const cv::Mat &image) const
+{
+	for (int i = 0; i < 2; i++)
+	{
+		const cv::Mat &gray = levels[i].gray;
+		if (!gray.empty() && image.datastart == gray.datastart && image.type() == gray.type()) return &levels[i];
+	}
+
+	return NULL;
+}
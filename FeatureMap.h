@@ -0,0 +1,36 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "RigidTransform.h"
+
+/*
+* Frame level corner response (minimal eigenvalue) that is shared by all trackers of a frame.
+* The response is computed in tiles and only where features are searched, each tile at most once
+* per frame, so the detection cost depends on the covered area rather than on the number of objects.
+* The current and the previous frame are kept since features are also added to the previous one.
+*/
+class FeatureMap
+{
+	struct Level
+	{
+		cv::Mat gray;
+		cv::Mat response;
+		std::vector<uchar> computed; // per tile
+	};
+
+	Level levels[2];
+	int current;
+	int cols, rows; // tiles
+
+public:
+	FeatureMap();
+	void setFrame(const cv::Mat &frame);
+	const cv::Mat & gray() const;
+	void cover(const cv::Mat &image, const cv::Rect &roi);
+	bool response(const cv::Mat &image, cv::Mat &eig) const;
+	static void select(const cv::Mat &eig, const cv::Mat &msk, Points &points, int max_count, float threshold, double min_distance);
+
+private:
+	const Level * levelOf(const cv::Mat &image) const;
+};
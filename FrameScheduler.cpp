@@ -0,0 +1,101 @@
+#include <algorithm>
+
+#include "FrameScheduler.h"
+#include "OFTracker.h"
+
+#define COST_SMOOTHING 0.3 // weight of the latest frame in the expected cost
+#define DEGRADE_RATIO 0.9 // of the budget above which the quality drops
+#define RESTORE_RATIO 0.6 // of the budget below which the quality may rise
+#define RESTORE_FRAMES 30 // frames of headroom before the quality rises
+#define SETTLE_FRAMES 5 // frames the cost needs to reflect a new quality level
+
+FrameScheduler::FrameScheduler()
+:
+budget(0),
+expected(0),
+last(0),
+quality(QUALITY_FULL),
+missed(0),
+settling(0),
+headroom(0),
+start(0)
+{
+}
+
+/*
+* Sets the time budget per frame in ms, 0 disables the scheduler and restores the full quality
+*/
+void FrameScheduler::setBudget(double ms)
+{
+	budget = std::max(0., ms);
+	expected = 0;
+	missed = 0;
+	settling = 0;
+	headroom = 0;
+
+	if (!isEnabled()) quality = QUALITY_FULL;
+}
+
+bool FrameScheduler::isEnabled() const
+{
+	return budget > 0;
+}
+
+/*
+* Starts the measurement of a frame
+*/
+void FrameScheduler::begin()
+{
+	start = cv::getTickCount();
+}
+
+/*
+* Ends the measurement of a frame and adapts the quality for the next one
+*/
+void FrameScheduler::end()
+{
+	last = (cv::getTickCount() - start) * 1000 / cv::getTickFrequency();
+	if (!isEnabled()) return;
+
+	if (last > budget) missed++;
+	expected = expected ? (1 - COST_SMOOTHING) * expected + COST_SMOOTHING * last : last;
+
+	headroom = expected < RESTORE_RATIO * budget ? headroom + 1 : 0;
+
+	if (settling)
+	{
+		settling--;
+		return;
+	}
+
+	if (expected > DEGRADE_RATIO * budget && quality < QUALITY_LOWEST)
+	{
+		quality++;
+		settling = SETTLE_FRAMES;
+		headroom = 0;
+	}
+	else if (headroom >= RESTORE_FRAMES && quality > QUALITY_FULL)
+	{
+		quality--;
+		settling = SETTLE_FRAMES;
+		headroom = 0;
+	}
+}
+
+int FrameScheduler::getQuality() const
+{
+	return quality;
+}
+
+/*
+* Number of frames that took longer than the budget since it was set
+*/
+int FrameScheduler::getMissed() const
+{
+	return missed;
+}
+
+double FrameScheduler::getLastCost() const
+{
+	return last;
+}
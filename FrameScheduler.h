@@ -0,0 +1,31 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+/*
+* Keeps the tracking of each frame within a time budget.
+* The expected cost of a frame follows the measured costs. When it comes close to the budget
+* the quality level drops by one (see OFTracker::setQuality), with plenty of headroom over
+* a longer stretch of frames it rises again.
+*/
+class FrameScheduler
+{
+	double budget; // ms per frame, 0 disables the scheduler
+	double expected; // ms, running average of the frame costs
+	double last; // ms, cost of the last frame
+	int quality;
+	int missed;
+	int settling; // frames to wait before the quality changes again
+	int headroom; // consecutive frames well within the budget
+	int64 start;
+
+public:
+	FrameScheduler();
+	void setBudget(double ms);
+	bool isEnabled() const;
+	void begin();
+	void end();
+	int getQuality() const;
+	int getMissed() const;
+	double getLastCost() const;
+};
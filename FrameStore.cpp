@@ -0,0 +1,121 @@
+#include <cstring>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "FrameStore.h"
+
+FrameStore::FrameStore(size_t capacity)
+:
+capacity(capacity),
+used(0)
+{
+}
+
+/*
+* Limits the memory of all images, older images are dropped right away if necessary. 0 disables the store.
+*/
+void FrameStore::setCapacity(size_t bytes)
+{
+	capacity = bytes;
+	if (capacity == 0) clear();
+	else evict();
+}
+
+void FrameStore::clear()
+{
+	frames.clear();
+	ages.clear();
+	used = 0;
+}
+
+/*
+* Stores the BGR image of frame.
+* A different image at a frame that is stored already means another video, all frames are dropped then.
+*/
+void FrameStore::add(size_t frame, const cv::Mat &image)
+{
+	if (capacity == 0 || image.empty()) return;
+
+	cv::Mat gray;
+	cv::cvtColor(image, gray, CV_BGR2GRAY);
+	size_t bytes = gray.total() * gray.elemSize();
+
+	std::map<size_t, Frame>::iterator it = frames.find(frame);
+	if (it != frames.end())
+	{
+		const cv::Mat &stored = it->second.gray;
+		if (stored.size() == gray.size() && memcmp(stored.data, gray.data, bytes) == 0)
+		{
+			ages.splice(ages.begin(), ages, it->second.age);
+			return;
+		}
+		clear();
+	}
+
+	ages.push_front(frame);
+	Frame &f = frames[frame];
+	f.gray = gray;
+	f.age = ages.begin();
+	used += bytes;
+
+	evict();
+}
+
+bool FrameStore::contains(size_t frame) const
+{
+	return frames.count(frame) > 0;
+}
+
+/*
+* Returns the gray image of frame, empty if it is not stored
+*/
+cv::Mat FrameStore::gray(size_t frame) const
+{
+	std::map<size_t, Frame>::const_iterator it = frames.find(frame);
+	if (it == frames.end()) return cv::Mat();
+	return it->second.gray;
+}
+
+/*
+* Restores the input of the trackers at frame, returns false if it is not stored
+*/
+bool FrameStore::image(size_t frame, cv::Mat &image) const
+{
+	cv::Mat g = gray(frame);
+	if (g.empty()) return false;
+
+	toImage(g, image);
+	return true;
+}
+
+size_t FrameStore::size() const
+{
+	return frames.size();
+}
+
+size_t FrameStore::bytes() const
+{
+	return used;
+}
+
+/*
+* BGR image the trackers convert to gray again without any loss
+*/
+void FrameStore::toImage(const cv::Mat &gray, cv::Mat &image)
+{
+	cv::cvtColor(gray, image, CV_GRAY2BGR);
+}
+
+/*
+* Drops the oldest images until they fit in the capacity, the most recent one is always kept
+*/
+void FrameStore::evict()
+{
+	while (used > capacity && ages.size() > 1)
+	{
+		std::map<size_t, Frame>::iterator it = frames.find(ages.back());
+		used -= it->second.gray.total() * it->second.gray.elemSize();
+		frames.erase(it);
+		ages.pop_back();
+	}
+}
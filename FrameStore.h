@@ -0,0 +1,42 @@
+#pragma once
+
+#include <list>
+#include <map>
+
+#include <opencv2/core/core.hpp>
+
+/*
+* Gray images of the frames the tracker has seen, limited to a number of bytes, the oldest ones are dropped first.
+* Unlike the CheckpointCache it doesn't depend on a tracker or its settings and is not cleared with them,
+* so paths can be tracked again over frames that were seen before, e.g. backwards from a box set later.
+* The trackers convert to gray anyway, gray images a third of the size are enough to restore their input.
+*/
+class FrameStore
+{
+	struct Frame
+	{
+		cv::Mat gray;
+		std::list<size_t>::iterator age;
+	};
+
+	std::map<size_t, Frame> frames;
+	std::list<size_t> ages; // frame numbers, most recently stored first
+	size_t capacity; // bytes
+	size_t used; // bytes
+
+public:
+	FrameStore(size_t capacity);
+	void setCapacity(size_t bytes);
+	void clear();
+	void add(size_t frame, const cv::Mat &image);
+	bool contains(size_t frame) const;
+	cv::Mat gray(size_t frame) const;
+	bool image(size_t frame, cv::Mat &image) const;
+	size_t size() const;
+	size_t bytes() const;
+
+	static void toImage(const cv::Mat &gray, cv::Mat &image);
+
+private:
+	void evict();
+};
@@ -1,32 +1,208 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <algorithm>
 
 #include "HoughHash.h"
 
-#define MAX_ROTATION_ANGLE 20
 #define ROTATION_STEPS 1
 #define STEPS_RND 2
 
-#define STEPS (2 * MAX_ROTATION_ANGLE + 1) / ROTATION_STEPS
+// the refinement recovers sub-bin accuracy, so the grid can be much coarser
+#define REFINED_ROTATION_STEPS 2
+#define REFINED_STEPS_RND 0.5f
+#define REFINE_ITERATIONS 2
+
+#define COARSE_BIN_SCALE 2 // bins are this much wider in every dimension with coarse bins
+
+// correspondences per thread below which threads don't pay off. Voting takes about 1.8 us per
+// correspondence at 41 rotation steps, 128 correspondences are well above the dispatch of parallel_for_.
+#define PARALLEL_MIN_VOTES 128
+#define PARALLEL_BLOCKS 4 // blocks per set with early termination, voting can stop after each block
+
+#define MAX_ROTATION_CENTER 180
+
+#define PAIRS_PER_POINT 4 // sampled correspondence pairs of the decoupled rotation estimate
+#define MAX_PAIRS 4096
+#define MIN_PAIR_DISTANCE 4.f // px, shorter pairs don't determine the rotation
+
+#define MAX_STEPS (2 * MAX_ROTATION_ANGLE + 1)
 #define HASH_MASK (HASH_SIZE - 1)
 
+class HoughVoting : public cv::ParallelLoopBody
+{
+	HoughHash *hough;
+	int parts;
+	const Points &from, &to;
+	const Weights &weights;
+	int begin, end;
+
+public:
+	HoughVoting(HoughHash *hough, int parts, const Points &from, const Points &to, const Weights &weights, int begin, int end)
+	: hough(hough), parts(parts), from(from), to(to), weights(weights), begin(begin), end(end) {}
+
+	void operator()(const cv::Range &range) const override
+	{
+		for (int part = range.start; part < range.end; part++)
+			hough->accumulate(part, parts, from, to, weights, begin, end);
+	}
+};
+
+class HoughMerging : public cv::ParallelLoopBody
+{
+	HoughHash *hough;
+	int ranges;
+
+public:
+	HoughMerging(HoughHash *hough, int ranges) : hough(hough), ranges(ranges) {}
+
+	void operator()(const cv::Range &range) const override
+	{
+		for (int r = range.start; r < range.end; r++)
+			hough->merge(r, ranges);
+	}
+};
+
 HoughHash::HoughHash()
 :
-maxcount(0),
-maxScores(0, 0),
-maxTransform(0, 0, 0)
+supportScale(1.f),
+steps(0),
+rotationStep(ROTATION_STEPS),
+translationSteps(STEPS_RND),
+rotationCenter(0),
+rotationRange(MAX_ROTATION_ANGLE),
+rotationStart(0),
+refine(false),
+coarse(false),
+terminateEarly(true),
+confidence(1.f),
+parallel(true),
+decoupled(false)
 {
-	A = new float*[STEPS];
+	A = new float*[MAX_STEPS];
 	
-	for (int i = 0; i < STEPS; i++)
+	for (int i = 0; i < MAX_STEPS; i++)
+		A[i] = new float[4];
+
+	buildRotations();
+
+	memset(hashmap, 0, HASH_SIZE * sizeof(hashmap[0]));
+	memset(hashmap2D, 0, HASH_SIZE * sizeof(hashmap2D[0]));
+	memset(hashmap3D, 0, HASH_SIZE * sizeof(hashmap3D[0]));
+}
+
+HoughHash::~HoughHash()
+{
+	for (int i = 0; i < MAX_STEPS; i++)
+		delete[] A[i];
+	delete[] A;
+}
+
+/*
+* Restricts the searched rotations to center +- range degrees.
+* The center is snapped to the rotation grid so that the bins of consecutive frames line up,
+* the range is capped at MAX_ROTATION_ANGLE.
+*/
+void HoughHash::setRotationWindow(float center, int range)
+{
+	int c = rotationStep * cvRound(center / rotationStep);
+	c = std::max(-MAX_ROTATION_CENTER, std::min(MAX_ROTATION_CENTER, c));
+	range = std::max(0, std::min(MAX_ROTATION_ANGLE, range));
+
+	if (c == rotationCenter && range == rotationRange) return;
+
+	rotationCenter = c;
+	rotationRange = range;
+	buildRotations();
+}
+
+/*
+* Enables the least squares refinement of the peak in estimate().
+* The refinement recovers sub-bin accuracy, therefore the grid is coarsened while it is enabled.
+*/
+void HoughHash::setRefinement(bool enabled)
+{
+	refine = enabled;
+	updateResolution();
+}
+
+/*
+* Widens the bins to trade accuracy for speed when time is short
+*/
+void HoughHash::setCoarseBins(bool enabled)
+{
+	coarse = enabled;
+	updateResolution();
+}
+
+void HoughHash::updateResolution()
+{
+	float translation_steps = refine ? REFINED_STEPS_RND : STEPS_RND;
+	int rotation_step = refine ? REFINED_ROTATION_STEPS : ROTATION_STEPS;
+
+	if (coarse)
+	{
+		translation_steps /= COARSE_BIN_SCALE;
+		rotation_step *= COARSE_BIN_SCALE;
+	}
+
+	setResolution(translation_steps, rotation_step);
+}
+
+/*
+* Lets estimate() stop voting as soon as the peak can't change anymore.
+* With confidence < 1 voting stops even earlier, when the lead of the peak exceeds
+* the given fraction of the outstanding votes.
+*/
+void HoughHash::setEarlyTermination(bool enabled, float confidence)
+{
+	terminateEarly = enabled;
+	this->confidence = confidence;
+}
+
+/*
+* Lets estimate() split the voting of large point sets across threads.
+*/
+void HoughHash::setParallel(bool enabled)
+{
+	parallel = enabled;
+}
+
+/*
+* Decoupled mode: estimate() first finds the rotation from a histogram of the angle differences
+* of sampled correspondence pairs over the full circle and then votes the translation at this rotation only.
+* One pass over the correspondences instead of one per rotation step, independent of the rotation window.
+*/
+void HoughHash::setDecoupled(bool enabled)
+{
+	decoupled = enabled;
+}
+
+void HoughHash::setResolution(float translation_steps, int rotation_step)
+{
+	if (translation_steps == translationSteps && rotation_step == rotationStep) return;
+
+	translationSteps = translation_steps;
+	rotationStep = rotation_step;
+	rotationCenter = rotationStep * cvRound(static_cast<float>(rotationCenter) / rotationStep);
+	buildRotations();
+}
+
+/*
+* precomputes the rotation matrices of the current rotation window
+*/
+void HoughHash::buildRotations()
+{
+	int range = rotationStep * ((rotationRange + rotationStep - 1) / rotationStep);
+	steps = 2 * range / rotationStep + 1;
+	rotationStart = rotationCenter - range;
+
+	for (int i = 0; i < steps; i++)
 	{
-        float a = static_cast<float>(ROTATION_STEPS * i - MAX_ROTATION_ANGLE);
+        float a = static_cast<float>(rotationStart + rotationStep * i);
 		
 		float cosa = float(cos(a * float(M_PI) / 180));
 		float sina = float(sin(a * float(M_PI) / 180));
 
-		A[i] = new float[4];
-
 		A[i][0] = cosa;
 		A[i][1] = sina;
 		A[i][2] = -sina;
@@ -34,82 +210,456 @@ maxTransform(0, 0, 0)
 	}
 }
 
-HoughHash::~HoughHash()
+/*
+* clears the bins that were voted for since the last reset
+*/
+void HoughHash::reset()
 {
-	for (int i = 0; i < STEPS; i++)
-		delete[] A[i];
-	delete[] A;
+	if (touched.size() > HASH_SIZE / 8)
+	{
+		memset(hashmap, 0, HASH_SIZE * sizeof(hashmap[0]));
+		memset(hashmap2D, 0, HASH_SIZE * sizeof(hashmap2D[0]));
+		memset(hashmap3D, 0, HASH_SIZE * sizeof(hashmap3D[0]));
+	}
+	else
+	{
+		for (size_t i = 0; i < touched.size(); i++)
+		{
+			hashmap[touched[i]] = 0;
+			hashmap2D[touched[i]] = cv::Point2f(0, 0);
+			hashmap3D[touched[i]] = cv::Point3f(0, 0, 0);
+		}
+	}
+	touched.clear();
+
+	peak = Peak();
+	supportScale = 1.f;
 }
 
-void HoughHash::reset()
+void HoughHash::fill(cv::Point2f p1, cv::Point2f p2, int score_or_punish)
 {
-	memset(hashmap, 0, HASH_SIZE * sizeof(hashmap[0]));
-	memset(hashmap2D, 0, HASH_SIZE * sizeof(hashmap2D[0]));
-	maxcount = 0;
-	maxScores = cvPoint(0,0);
+	for (int i = 0; i < steps; i++)
+	{
+		cv::Point3f T = transformAt(i, p1, p2);
+		add(binOf(T), T, score_or_punish);
+	}
 }
 
-void HoughHash::fill(cv::Point2f p1, cv::Point2f p2, int score_or_punish)
+/*
+* Adds one vote to a bin and keeps track of the peak, penalties are ignored for the peak.
+*/
+void HoughHash::add(unsigned long hash, const cv::Point3f &T, int score_or_punish)
 {
-	uint64 Key;
-	cv::Point3f T;
-	cv::Point3i rT;
-	unsigned long hash;
-	int count;
-	int num_of_hits_with_same_score = 1;
+	if (!score_or_punish) return;
+
+	if (hashmap2D[hash].x == 0 && hashmap2D[hash].y == 0) touched.push_back(hash);
 
-	for (int i = 0; i < STEPS; i++)
+	hashmap[hash] += score_or_punish;
+
+	if (score_or_punish < 0)
 	{
-        T.z = static_cast<float>(ROTATION_STEPS*i - MAX_ROTATION_ANGLE);
+		hashmap2D[hash].y += -score_or_punish;
+		return;
+	}
 
-		// A*p0 + t = p1 => A*p0-p1 = -t
-		T.x = - (A[i][0]*p1.x + A[i][1]*p1.y - p2.x); //resulting translation (tx, ty)
-		T.y = - (A[i][2]*p1.x + A[i][3]*p1.y - p2.y);
+	hashmap2D[hash].x += score_or_punish;
+	hashmap3D[hash] += T * static_cast<float>(score_or_punish);
 
-		rT = roundTransform(T);
+	raise(peak, hash);
+}
+
+/*
+* Updates a peak after the count of a bin went up.
+* If several bins share the highest count, the peak transform is the weighted mean of all votes of these bins.
+* This only depends on the votes and not on their order, so serial and parallel voting agree.
+*/
+void HoughHash::raise(Peak &p, unsigned long hash)
+{
+	int count = static_cast<int>(hashmap2D[hash].x);
 
-		Key = makeKey(rT.x, rT.y, rT.z);
+	if (count > p.count)
+	{
+		// tied bins that were left behind are the runner-up now
+		if (hash != p.hash || p.ties > 1) p.second = p.count;
+
+		p.count = count;
+		p.hash = hash;
+		p.ties = 1;
+		p.sum = hashmap3D[hash];
+		p.weight = count;
+	}
+	else if (count == p.count)
+	{
+		p.second = p.count;
+		p.ties++;
+		p.sum += hashmap3D[hash];
+		p.weight += count;
+	}
+	else if (count > p.second)
+		p.second = count;
+}
 
-		hash = sdbm(reinterpret_cast<unsigned char*>(&Key), 8) & HASH_MASK ;
+/*
+* Votes of one thread for its share of the correspondences begin..end, summed per bin in its own accumulator.
+* The touched bins are sorted into the hash ranges of the merge right away.
+*/
+void HoughHash::accumulate(int part, int parts, const Points &from, const Points &to, const Weights &weights, int begin, int end)
+{
+	Accumulator &acc = partials[part];
+	int first = begin + (end - begin) * part / parts;
+	int last = begin + (end - begin) * (part + 1) / parts;
 
-		hashmap[hash] += score_or_punish;
-		
-		if (score_or_punish > 0)
-			hashmap2D[hash].x += score_or_punish;
-		else
-			hashmap2D[hash].y += -score_or_punish;
+	for (int j = first; j < last; j++)
+	{
+		int w = weights[j];
+		if (w <= 0) continue;
+
+		for (int i = 0; i < steps; i++)
+		{
+			cv::Point3f T = transformAt(i, from[j], to[j]);
+			unsigned long hash = binOf(T);
+
+			if (!acc.counts[hash]) acc.touched[hash * parts / HASH_SIZE].push_back(hash);
+
+			acc.counts[hash] += w;
+			acc.sums[hash] += T * static_cast<float>(w);
+		}
+	}
+}
+
+/*
+* Adds the bins of one hash range of all accumulators to the hashmaps and clears them in the accumulators.
+* The ranges are disjoint, so every range is merged by one thread and keeps its own peak.
+*/
+void HoughHash::merge(int range, int ranges)
+{
+	Peak &p = rangePeaks[range];
+
+	for (int part = 0; part < ranges; part++)
+	{
+		Accumulator &acc = partials[part];
+		std::vector<unsigned long> &bins = acc.touched[range];
+
+		for (size_t k = 0; k < bins.size(); k++)
+		{
+			unsigned long hash = bins[k];
+
+			if (hashmap2D[hash].x == 0 && hashmap2D[hash].y == 0) rangeTouched[range].push_back(hash);
+
+			hashmap[hash] += acc.counts[hash];
+			hashmap2D[hash].x += acc.counts[hash];
+			hashmap3D[hash] += acc.sums[hash];
+
+			acc.counts[hash] = 0;
+			acc.sums[hash] = cv::Point3f(0, 0, 0);
+
+			raise(p, hash);
+		}
+		bins.clear();
+	}
+}
+
+/*
+* peak of all bins from the peaks of the hash ranges, with the ties across ranges
+*/
+void HoughHash::combinePeaks(int ranges)
+{
+	Peak combined;
 
-        count = static_cast<int>(hashmap2D[hash].x); //ignore penalties
+	for (int r = 0; r < ranges; r++)
+	{
+		const Peak &p = rangePeaks[r];
 
-		if (count >= maxcount)
+		if (p.count > combined.count)
 		{
-			if (count == maxcount) //then we need to average the transform parameters sharing the same amount of votes
+			int second = std::max(combined.count, p.second);
+			combined = p;
+			combined.second = second;
+		}
+		else if (p.count == combined.count && p.count > 0)
+		{
+			combined.second = combined.count;
+			combined.ties += p.ties;
+			combined.sum += p.sum;
+			combined.weight += p.weight;
+		}
+		else if (p.count > combined.second)
+			combined.second = p.count;
+
+		touched.insert(touched.end(), rangeTouched[r].begin(), rangeTouched[r].end());
+		rangeTouched[r].clear();
+	}
+
+	peak = combined;
+}
+
+/*
+* true if remaining_score more votes can't change the peak anymore:
+* every correspondence adds to a bin at most once, so no other bin can catch up
+* once the lead over the runner-up exceeds the outstanding score.
+*/
+bool HoughHash::isDecided(int remaining_score, float confidence) const
+{
+	return peak.count - peak.second > confidence * remaining_score;
+}
+
+cv::Point3f HoughHash::getMaxTransform(int * score, cv::Point2f * scores)
+{
+	if(score) (*score) = static_cast<int>(peak.count * supportScale);
+	if(scores)
+	{
+		(*scores) = peak.hash < HASH_SIZE ? hashmap2D[peak.hash] : cv::Point2f(0, 0);
+		scores->x *= supportScale;
+	}
+
+	if (!peak.weight) return cv::Point3f(0, 0, 0);
+
+	return unRoundTransform(roundTransform(peak.sum * (1.f / peak.weight)));
+}
+
+/*
+* Peak of votes that were filled in directly, refined with the voted correspondences if enabled.
+* Without the refinement the peak would be as coarse as the grid of the refinement mode.
+*/
+cv::Point3f HoughHash::getMaxTransform(const Points &from, const Points &to, const Weights &weights, int * score, cv::Point2f * scores)
+{
+	cv::Point3f T = getMaxTransform(score, scores);
+
+	if (refine && !from.empty()) T = refineTransform(from, to, weights, T);
+
+	return T;
+}
+
+/*
+* Votes for all correspondences from[i] -> to[i] with score weights[i] and returns the most likely transform,
+* refined if enabled.
+*/
+cv::Point3f HoughHash::estimate(const Points &from, const Points &to, const Weights &weights, int * score, cv::Point2f * scores)
+{
+	reset();
+
+	float angle;
+	if (decoupled && estimateRotation(from, to, weights, angle))
+	{
+		int center = rotationCenter, range = rotationRange;
+
+		setRotationWindow(angle, 0);
+		vote(from, to, weights);
+		setRotationWindow(static_cast<float>(center), range);
+	}
+	else
+		vote(from, to, weights);
+
+	cv::Point3f T = getMaxTransform(score, scores);
+
+	if (refine) T = refineTransform(from, to, weights, T);
+
+	return T;
+}
+
+/*
+* Votes for all correspondences with their weights as score.
+* Large sets are split across threads: every thread votes for its share into its own accumulator,
+* then the accumulators are merged in parallel, one hash range per thread, and the peaks of the ranges are combined.
+* With early termination this runs in a few blocks, so voting can still stop after a block.
+* If voting stops early, the support of the peak is extrapolated to all correspondences,
+* so that it stays comparable to the total weight.
+*/
+void HoughHash::vote(const Points &from, const Points &to, const Weights &weights)
+{
+	int n = static_cast<int>(from.size());
+
+	int64 total = 0;
+	for (int i = 0; i < n; i++)
+		total += weights[i];
+
+	int remaining = static_cast<int>(total);
+
+	int parts = 1;
+	if (parallel && steps > 1 && cv::getNumThreads() > 1 && n >= 2 * PARALLEL_MIN_VOTES)
+		parts = std::min(cv::getNumThreads(), n / PARALLEL_MIN_VOTES);
+
+	if (parts > 1)
+	{
+		// the accumulators are cleared by the merge, they are only allocated once
+		if (static_cast<int>(partials.size()) < parts) partials.resize(parts);
+		for (int part = 0; part < parts; part++)
+		{
+			if (partials[part].counts.empty())
 			{
-				//running average
-				maxTransform *= num_of_hits_with_same_score;
-				num_of_hits_with_same_score++;
-				maxTransform = (maxTransform + T) * (1.0 / num_of_hits_with_same_score);
+				partials[part].counts.assign(HASH_SIZE, 0);
+				partials[part].sums.assign(HASH_SIZE, cv::Point3f(0, 0, 0));
 			}
-			else
+			partials[part].touched.resize(parts);
+		}
+		rangePeaks.assign(parts, Peak());
+		rangeTouched.resize(parts);
+
+		int block = n;
+		if (terminateEarly) block = std::max(parts * PARALLEL_MIN_VOTES, (n + PARALLEL_BLOCKS - 1) / PARALLEL_BLOCKS);
+
+		for (int begin = 0; begin < n; begin += block)
+		{
+			int end = std::min(n, begin + block);
+
+			cv::parallel_for_(cv::Range(0, parts), HoughVoting(this, parts, from, to, weights, begin, end));
+			cv::parallel_for_(cv::Range(0, parts), HoughMerging(this, parts));
+			combinePeaks(parts);
+
+			for (int i = begin; i < end; i++)
+				remaining -= weights[i];
+
+			if (terminateEarly && isDecided(remaining, confidence)) break;
+		}
+	}
+	else
+	{
+		for (int i = 0; i < n; i++)
+		{
+			fill(from[i], to[i], weights[i]);
+			remaining -= weights[i];
+
+			if (terminateEarly && isDecided(remaining, confidence)) break;
+		}
+	}
+
+	if (remaining > 0 && total > remaining)
+		supportScale = static_cast<float>(total) / (total - remaining);
+}
+
+/*
+* Rotation of the rigid motion from the angle differences of correspondence pairs:
+* a rigid motion turns the vector between any two points by the same angle, whatever the translation.
+* The angles are histogrammed over the full circle, weighted with the lower weight of the pair,
+* the peak (together with its neighbours) is averaged.
+* Returns false if no pair was long enough.
+*/
+bool HoughHash::estimateRotation(const Points &from, const Points &to, const Weights &weights, float &angle)
+{
+	int n = static_cast<int>(from.size());
+	if (n < 2) return false;
+
+	int bins = 360 / rotationStep;
+	angleHistogram.assign(bins, 0);
+	angleSums.assign(bins, 0.f);
+
+	std::uniform_int_distribution<int> pick(0, n - 1);
+	int pairs = std::min(MAX_PAIRS, PAIRS_PER_POINT * n);
+	int voted = 0;
+
+	for (int k = 0; k < pairs; k++)
+	{
+		int i = pick(g), j = pick(g);
+
+		cv::Point2f va = from[j] - from[i], vb = to[j] - to[i];
+		if (va.dot(va) < MIN_PAIR_DISTANCE * MIN_PAIR_DISTANCE) continue;
+
+		// A(phi) rotates by -phi
+		float a = static_cast<float>((atan2(va.y, va.x) - atan2(vb.y, vb.x)) * 180 / M_PI);
+		a = static_cast<float>(fmod(a + 540, 360)) - 180;
+
+		int bin = cvRound((a + 180) / rotationStep) % bins;
+		float offset = a - (bin * rotationStep - 180);
+		if (offset >= 180) offset -= 360; // wrapped into the first bin
+
+		int w = std::min(weights[i], weights[j]);
+		angleHistogram[bin] += w;
+		angleSums[bin] += w * offset;
+		voted++;
+	}
+
+	if (!voted) return false;
+
+	int best = 0, best_support = -1;
+	for (int b = 0; b < bins; b++)
+	{
+		int support = angleHistogram[(b + bins - 1) % bins] + angleHistogram[b] + angleHistogram[(b + 1) % bins];
+		if (support > best_support)
+		{
+			best_support = support;
+			best = b;
+		}
+	}
+
+	// mean of the three bins around the peak, relative to the center of the peak bin
+	float sum = 0;
+	for (int d = -1; d <= 1; d++)
+	{
+		int b = (best + d + bins) % bins;
+		sum += angleSums[b] + angleHistogram[b] * d * rotationStep;
+	}
+
+	angle = best * rotationStep - 180 + sum / best_support;
+	return true;
+}
+
+/*
+* Collects the correspondences that agree with T up to the bin size
+* and fits the rigid transform to them in closed form.
+* Returns T unchanged if less than two correspondences agree.
+*/
+cv::Point3f HoughHash::refineTransform(const Points &from, const Points &to, const Weights &weights, cv::Point3f T)
+{
+	Points inliers_from, inliers_to;
+	std::vector<float> inlier_weights;
+
+	float bin = 1.f / translationSteps;
+	float rotation_bin = rotationStep * float(M_PI) / 180;
+
+	for (int it = 0; it < REFINE_ITERATIONS; it++)
+	{
+		inliers_from.clear();
+		inliers_to.clear();
+		inlier_weights.clear();
+
+		for (int i = 0; i < static_cast<int>(from.size()); i++)
+		{
+			cv::Point2f d = applyRigidTransform(T, from[i]) - to[i];
+			float tolerance = bin + 0.5f * rotation_bin * static_cast<float>(cv::norm(from[i]));
+
+			if (d.dot(d) <= tolerance * tolerance)
 			{
-				num_of_hits_with_same_score = 1;
-				maxTransform = T;
-				maxcount = count;
-				maxScores = hashmap2D[hash];
+				inliers_from.push_back(from[i]);
+				inliers_to.push_back(to[i]);
+				inlier_weights.push_back(static_cast<float>(weights[i]));
 			}
 		}
+
+		if (inliers_from.size() < 2) break;
+
+		T = fitRigidTransform(inliers_from, inliers_to, inlier_weights);
 	}
-	
+
+	return T;
 }
 
-cv::Point3f HoughHash::getMaxTransform(int * score, cv::Point2f * scores)
+
+/*
+* transform that maps p1 onto p2 with the i-th rotation of the window
+*/
+cv::Point3f HoughHash::transformAt(int i, const cv::Point2f &p1, const cv::Point2f &p2) const
 {
-	if(score) (*score) = maxcount;
-	if(scores) (*scores) = maxScores;
+	cv::Point3f T;
+
+	T.z = static_cast<float>(rotationStart + rotationStep * i);
+
+	// A*p0 + t = p1 => A*p0-p1 = -t
+	T.x = - (A[i][0]*p1.x + A[i][1]*p1.y - p2.x); //resulting translation (tx, ty)
+	T.y = - (A[i][2]*p1.x + A[i][3]*p1.y - p2.y);
 
-	return unRoundTransform(roundTransform(maxTransform));
+	return T;
 }
 
+/*
+* index of the hashmap bin T falls into
+*/
+unsigned long HoughHash::binOf(const cv::Point3f &T)
+{
+	cv::Point3i rT = roundTransform(T);
+	uint64 Key = makeKey(rT.x, rT.y, rT.z);
+
+	return sdbm(reinterpret_cast<unsigned char*>(&Key), 8) & HASH_MASK;
+}
 
 cv::Point3i HoughHash::roundTransform(cv::Point3f T)
 {
@@ -134,8 +684,8 @@ cv::Point3i HoughHash::roundTransform(cv::Point3f T)
 	
 	*/
 
-    R.x = static_cast<int>(10.0 * (static_cast<float>(cvRound(STEPS_RND * T.x)) / STEPS_RND));
-    R.y = static_cast<int>(10.0 * (static_cast<float>(cvRound(STEPS_RND * T.y)) / STEPS_RND));
+    R.x = static_cast<int>(10.0 * (static_cast<float>(cvRound(translationSteps * T.x)) / translationSteps));
+    R.y = static_cast<int>(10.0 * (static_cast<float>(cvRound(translationSteps * T.y)) / translationSteps));
     R.z = static_cast<int>(10.0 * (static_cast<float>(cvRound(STEPS_RND * T.z)) / STEPS_RND));
 
 	return R;
@@ -1,27 +1,97 @@
 #pragma once
 
+#include <random>
+
 #include <opencv2/core/core.hpp>
 
+#include "RigidEstimator.h"
+
 #define HASH_SIZE 131072
+#define MAX_ROTATION_ANGLE 20
 
-class HoughHash
+class HoughHash : public RigidEstimator
 {
-	int maxcount;
-	cv::Point2f maxScores;
-	cv::Point3f maxTransform;
+	friend class HoughVoting;
+	friend class HoughMerging;
+
+	struct Peak // bin with the highest count, together with the bins tied with it
+	{
+		int count;
+		int second; // highest count of all other bins
+		unsigned long hash;
+		int ties; // bins sharing the peak count
+		cv::Point3f sum; // weighted sum of the votes of the tied bins
+		int weight;
+
+		Peak() : count(0), second(0), hash(HASH_SIZE), ties(0), sum(0, 0, 0), weight(0) {}
+	};
+
+	struct Accumulator // votes of one thread, summed per bin until they are merged into the hashmaps
+	{
+		std::vector<int> counts;
+		std::vector<cv::Point3f> sums;
+		std::vector<std::vector<unsigned long> > touched; // per hash range of the merge
+	};
+
+	Peak peak;
+	float supportScale; // extrapolates the support of the peak to all votes when voting stopped early
 	float ** A; // M 2x2 matrices written as vector (a11 a12 a21 a22)
+	int steps;
+	int rotationStep; // degrees between two rotation bins
+	float translationSteps; // translation bins per pixel
+	int rotationCenter; // the rotation window spans rotationCenter +- rotationRange degrees
+	int rotationRange;
+	int rotationStart; // angle of the first rotation matrix
+	bool refine;
+	bool coarse;
+	bool terminateEarly;
+	float confidence;
+	bool parallel;
+	std::vector<Accumulator> partials; // one per thread, kept between frames
+	std::vector<Peak> rangePeaks;
+	std::vector<std::vector<unsigned long> > rangeTouched;
+	bool decoupled;
+	std::vector<int> angleHistogram;
+	std::vector<float> angleSums; // sum of the angle offsets to the bin center, per bin
+	std::default_random_engine g;
 	
 	int hashmap[HASH_SIZE];
 	cv::Point2f hashmap2D[HASH_SIZE];
+	cv::Point3f hashmap3D[HASH_SIZE]; // weighted sum of the voted transforms
+	std::vector<unsigned long> touched; // bins that reset() has to clear
 	
 public:
 	HoughHash();
 	~HoughHash();
 	void fill(cv::Point2f p1, cv::Point2f p2, int score_or_punish);
 	void reset();
+	virtual void setRotationWindow(float center, int range) override;
+	void setRefinement(bool enabled);
+	void setCoarseBins(bool enabled);
+	void setEarlyTermination(bool enabled, float confidence = 1.f);
+	void setParallel(bool enabled);
+	void setDecoupled(bool enabled);
+	bool isDecided(int remaining_score, float confidence = 1.f) const;
+	virtual cv::Point3f estimate(const Points &from, const Points &to, const Weights &weights, int * score = 0, cv::Point2f * scores = 0) override;
 	cv::Point3f getMaxTransform(int * score = 0, cv::Point2f * scores = 0);
+	cv::Point3f getMaxTransform(const Points &from, const Points &to, const Weights &weights, int * score = 0, cv::Point2f * scores = 0);
+	cv::Point3f refineTransform(const Points &from, const Points &to, const Weights &weights, cv::Point3f T);
 	uint64 makeKey(int a, int b, int c);
 	unsigned long sdbm(unsigned char *str, int length); //hash function
 	cv::Point3i roundTransform(cv::Point3f T);
 	cv::Point3f unRoundTransform(cv::Point3i T);
+
+private:
+	void setResolution(float translation_steps, int rotation_step);
+	void updateResolution();
+	void buildRotations();
+	cv::Point3f transformAt(int i, const cv::Point2f &p1, const cv::Point2f &p2) const;
+	unsigned long binOf(const cv::Point3f &T);
+	void add(unsigned long hash, const cv::Point3f &T, int score_or_punish);
+	void raise(Peak &p, unsigned long hash);
+	void accumulate(int part, int parts, const Points &from, const Points &to, const Weights &weights, int begin, int end);
+	void merge(int range, int ranges);
+	void combinePeaks(int ranges);
+	bool estimateRotation(const Points &from, const Points &to, const Weights &weights, float &angle);
+	void vote(const Points &from, const Points &to, const Weights &weights);
 };
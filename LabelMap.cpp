@@ -0,0 +1,153 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "LabelMap.h"
+
+#define CELL_SIZE 64 // px
+#define RIM_WIDTH_SCALE 2.f // same rim as a Mask
+#define RIM_HEIGHT_SCALE 1.5f
+
+LabelMap::LabelMap()
+:
+indexed(false),
+cols(0),
+rows(0)
+{
+}
+
+void LabelMap::clear()
+{
+	regions.clear();
+	indexed = false;
+}
+
+/*
+* Adds the box and rim of an object and returns its label.
+* Labels are given in order of addition, starting with 0.
+*/
+int LabelMap::add(const FlowBox &bb)
+{
+	Region r;
+	float p = bb.phi * float(M_PI) / 180;
+
+	r.center = cv::Point2f(bb.x, bb.y);
+	r.cosp = cos(p);
+	r.sinp = sin(p);
+	r.box_w2 = bb.w / 2;
+	r.box_h2 = bb.h / 2;
+	r.rim_w2 = r.box_w2 * RIM_WIDTH_SCALE;
+	r.rim_h2 = r.box_h2 * RIM_HEIGHT_SCALE;
+
+	FlowBox rim(bb);
+	rim.w = bb.w * RIM_WIDTH_SCALE;
+	rim.h = bb.h * RIM_HEIGHT_SCALE;
+	std::vector<cv::Point> pnts = rim.getCornerPoints();
+	r.bounds = cv::boundingRect(pnts);
+
+	regions.push_back(r);
+	indexed = false;
+
+	return static_cast<int>(regions.size()) - 1;
+}
+
+/*
+* Returns INSIDE_FlowBox, INSIDE_RIM or 0 for p, and the label of the object in label if given
+*/
+char LabelMap::getValue(const cv::Point2f &p, int *label)
+{
+	if (label) *label = NO_LABEL;
+	if (!indexed) buildIndex();
+
+	int c = (static_cast<int>(floor(p.x)) - origin.x) / CELL_SIZE;
+	int r = (static_cast<int>(floor(p.y)) - origin.y) / CELL_SIZE;
+	if (p.x < origin.x || p.y < origin.y || c >= cols || r >= rows) return 0;
+
+	char value = 0;
+	int cell = r * cols + c;
+
+	for (int i = cell_start[cell]; i < cell_start[cell + 1]; i++)
+	{
+		const Region &region = regions[cell_labels[i]];
+		cv::Point2f d = p - region.center;
+
+		// coordinates along the width and the height of the box
+		float u = fabs(d.x * region.cosp - d.y * region.sinp);
+		float v = fabs(d.x * region.sinp + d.y * region.cosp);
+
+		if (u <= region.box_w2 && v <= region.box_h2)
+		{
+			if (label) *label = cell_labels[i];
+			return INSIDE_FlowBox;
+		}
+
+		if (!value && u <= region.rim_w2 && v <= region.rim_h2)
+		{
+			if (label) *label = cell_labels[i];
+			value = INSIDE_RIM;
+		}
+	}
+
+	return value;
+}
+
+/*
+* Sorts the labels into the grid cells their rims overlap
+*/
+void LabelMap::buildIndex()
+{
+	indexed = true;
+	cols = rows = 0;
+	cell_start.assign(1, 0);
+	cell_labels.clear();
+
+	if (regions.empty()) return;
+
+	cv::Rect bounds = regions[0].bounds;
+	for (int i = 1; i < static_cast<int>(regions.size()); i++)
+		bounds |= regions[i].bounds;
+
+	origin = bounds.tl();
+	cols = bounds.width / CELL_SIZE + 1;
+	rows = bounds.height / CELL_SIZE + 1;
+
+	// count, accumulate and fill
+	cell_start.assign(cols * rows + 1, 0);
+	for (int i = 0; i < static_cast<int>(regions.size()); i++)
+	{
+		cv::Rect cells = cellsOf(regions[i].bounds);
+		for (int r = cells.y; r < cells.y + cells.height; r++)
+			for (int c = cells.x; c < cells.x + cells.width; c++)
+				cell_start[r * cols + c + 1]++;
+	}
+
+	for (int i = 0; i < cols * rows; i++)
+		cell_start[i + 1] += cell_start[i];
+
+	std::vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+	cell_labels.resize(cell_start.back());
+
+	for (int i = 0; i < static_cast<int>(regions.size()); i++)
+	{
+		cv::Rect cells = cellsOf(regions[i].bounds);
+		for (int r = cells.y; r < cells.y + cells.height; r++)
+			for (int c = cells.x; c < cells.x + cells.width; c++)
+				cell_labels[fill[r * cols + c]++] = i;
+	}
+}
+
+/*
+* Range of grid cells covered by bounds
+*/
+cv::Rect LabelMap::cellsOf(const cv::Rect &bounds) const
+{
+	int c0 = (bounds.x - origin.x) / CELL_SIZE;
+	int r0 = (bounds.y - origin.y) / CELL_SIZE;
+	int c1 = std::min((bounds.x + bounds.width - origin.x) / CELL_SIZE, cols - 1);
+	int r1 = std::min((bounds.y + bounds.height - origin.y) / CELL_SIZE, rows - 1);
+
+	return cv::Rect(c0, r0, c1 - c0 + 1, r1 - r0 + 1);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "FlowBox.h"
+#include "Mask.h"
+
+#define NO_LABEL -1
+
+/*
+* Tells which object's box or rim contains a point, for any number of objects at once.
+* Boxes are tested analytically, a grid over their bounds keeps the candidates of a lookup few.
+* Memory depends on the covered area, not on the frame size. The values match those of a Mask:
+* INSIDE_FlowBox, INSIDE_RIM or 0. A box takes precedence over the rim of another object.
+*/
+class LabelMap
+{
+	struct Region
+	{
+		cv::Point2f center;
+		float cosp, sinp;
+		float box_w2, box_h2; // half extents
+		float rim_w2, rim_h2;
+		cv::Rect bounds; // of the rim
+	};
+
+	std::vector<Region> regions;
+	bool indexed;
+	cv::Point origin;
+	int cols, rows;
+	std::vector<int> cell_start; // labels of cell i are cell_labels[cell_start[i] .. cell_start[i + 1]]
+	std::vector<int> cell_labels;
+
+public:
+	LabelMap();
+	void clear();
+	int add(const FlowBox &bb);
+	char getValue(const cv::Point2f &p, int *label = NULL);
+
+private:
+	void buildIndex();
+	cv::Rect cellsOf(const cv::Rect &bounds) const;
+};
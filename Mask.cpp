@@ -1,3 +1,5 @@
+#include <opencv2/imgproc/imgproc.hpp>
+
 #include "Mask.h"
 
 Mask::Mask()
@@ -12,11 +14,14 @@ Mask::~Mask()
 void Mask::init(cv::Size size)
 {
 	mask = cv::Mat::zeros(size, CV_8UC1);
+	roi = cv::Rect();
 }
 	
 void Mask::set(const FlowBox &bb)
 {
-	mask.setTo(0);
+	// only the previous box was drawn
+	if (roi.area()) mask(roi).setTo(0);
+	roi = cv::Rect();
 
 	if(bb.w == 0 || bb.h == 0) return;
 
@@ -25,6 +30,9 @@ void Mask::set(const FlowBox &bb)
 	large.w = bb.w * 2;
 	large.h = bb.h * 1.5f;
 
+	std::vector<cv::Point> pnts = large.getCornerPoints();
+	roi = cv::boundingRect(pnts) & cv::Rect(0, 0, mask.cols, mask.rows);
+
 	drawBoundingBoxFilled(mask, large, cv::Scalar(INSIDE_RIM));
 	drawBoundingBoxFilled(mask, bb, cv::Scalar(INSIDE_FlowBox));
 }
@@ -11,6 +11,7 @@ class Mask
 {
 public:
 	cv::Mat mask;
+	cv::Rect roi; // bounding rectangle of the non-zero area
 
 	Mask();
 	~Mask();
@@ -0,0 +1,131 @@
+#include <math.h>
+#include <algorithm>
+
+#include "HoughHash.h"
+#include "MotionPredictor.h"
+
+#define HISTORY_LENGTH 5
+#define MIN_HISTORY 3 // poses needed before the prediction is trusted
+#define MIN_ROTATION_RANGE 4
+#define ROTATION_MARGIN 2
+#define STEADY_TRANSLATION 2.f
+#define STEADY_ROTATION 2.f
+
+/*
+* signed difference a - b of two angles in degrees, wrapped to [-180, 180)
+*/
+static float angleDifference(float a, float b)
+{
+	return static_cast<float>(fmod(a - b + 900, 360)) - 180;
+}
+
+MotionPredictor::MotionPredictor()
+:
+velocity(0, 0, 0),
+deviation(0, 0, 0)
+{
+}
+
+void MotionPredictor::reset()
+{
+	poses.clear();
+	spans.clear();
+	velocity = cv::Point3f(0, 0, 0);
+	deviation = cv::Point3f(0, 0, 0);
+}
+
+/*
+* adds the pose of bb, span frames after the previous pose
+*/
+void MotionPredictor::update(const FlowBox &bb, int span)
+{
+	poses.push_back(cv::Point3f(bb.x, bb.y, bb.phi));
+	spans.push_back(std::max(1, span));
+	if (poses.size() > HISTORY_LENGTH)
+	{
+		poses.pop_front();
+		spans.pop_front();
+	}
+
+	estimate();
+}
+
+bool MotionPredictor::isEmpty() const
+{
+	return poses.empty();
+}
+
+bool MotionPredictor::hasHistory() const
+{
+	return poses.size() >= MIN_HISTORY;
+}
+
+/*
+* Expected transform from the last known pose to the pose span frames later.
+* Zero motion until enough poses are known.
+*/
+cv::Point3f MotionPredictor::predict(int span) const
+{
+	if (!hasHistory()) return cv::Point3f(0, 0, 0);
+	return velocity * span;
+}
+
+/*
+* Largest displacement (in px) the prediction of span frames recently missed for a point
+* at radius from the rotation center, -1 without history
+*/
+float MotionPredictor::residual(float radius, int span) const
+{
+	if (!hasHistory()) return -1;
+
+	return span * (std::max(deviation.x, deviation.y) + radius * deviation.z * float(CV_PI) / 180);
+}
+
+/*
+* Half width of the rotation window (in degrees) the HoughHash has to search around the turn predicted for span frames.
+* Steady turning allows a narrow window, erratic motion falls back to the full range.
+*/
+int MotionPredictor::rotationRange(int span) const
+{
+	if (!hasHistory()) return MAX_ROTATION_ANGLE;
+
+	int range = ROTATION_MARGIN + cvCeil(2 * span * deviation.z);
+	return std::max(MIN_ROTATION_RANGE, std::min(MAX_ROTATION_ANGLE, range));
+}
+
+/*
+* true if recent steps barely deviate from the constant velocity model
+*/
+bool MotionPredictor::isSteady() const
+{
+	return hasHistory() &&
+		std::max(deviation.x, deviation.y) < STEADY_TRANSLATION &&
+		deviation.z < STEADY_ROTATION;
+}
+
+void MotionPredictor::estimate()
+{
+	velocity = cv::Point3f(0, 0, 0);
+	deviation = cv::Point3f(0, 0, 0);
+
+	int n = static_cast<int>(poses.size()) - 1;
+	if (n < 1) return;
+
+	// steps across several frames count with their motion per frame
+	std::vector<cv::Point3f> steps(n);
+	for (int i = 0; i < n; i++)
+	{
+		steps[i] = cv::Point3f(poses[i + 1].x - poses[i].x,
+			poses[i + 1].y - poses[i].y,
+			angleDifference(poses[i + 1].z, poses[i].z)) * (1.0 / spans[i + 1]);
+		velocity += steps[i];
+	}
+	velocity *= 1.0 / n;
+
+	for (int i = 0; i < n; i++)
+	{
+		deviation.x = std::max(deviation.x, std::abs(steps[i].x - velocity.x));
+		deviation.y = std::max(deviation.y, std::abs(steps[i].y - velocity.y));
+		deviation.z = std::max(deviation.z, std::abs(steps[i].z - velocity.z));
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <deque>
+
+#include <opencv2/core/core.hpp>
+
+#include "FlowBox.h"
+
+/*
+* Constant velocity model over the most recent poses of one FlowBox.
+* Predictions are rigid transforms (tx, ty, phi) in the convention of HoughHash
+* and FlowBox::applyTransform.
+*/
+class MotionPredictor
+{
+	std::deque<cv::Point3f> poses; // (x, y, phi), oldest first
+	std::deque<int> spans; // frames between each pose and the one before it
+	cv::Point3f velocity; // per frame
+	cv::Point3f deviation; // largest deviation of a single step from the velocity
+
+public:
+	MotionPredictor();
+	void reset();
+	void update(const FlowBox &bb, int span = 1);
+	bool isEmpty() const;
+	bool hasHistory() const;
+	cv::Point3f predict(int span = 1) const;
+	float residual(float radius, int span = 1) const;
+	int rotationRange(int span = 1) const;
+	bool isSteady() const;
+
+private:
+	void estimate();
+};
@@ -1,35 +1,98 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <opencv2/video/tracking.hpp>
+
 #include "OFTracker.h"
+#include "RansacEstimator.h"
 
 #define FEATURE_COLOR 0, 255, 255
+#define PYRAMID_LEVELS 3 // while the motion is unknown
+#define MAX_PYRAMID_LEVELS 4
+#define MIN_WINDOW_SIZE 7 // px, the optical flow window grows with the box
+#define MAX_WINDOW_SIZE 15
+#define WINDOW_BOX_RATIO 0.25f // of the shorter side of the box
+#define LK_ITERATIONS 40
+#define STEADY_LK_ITERATIONS 20 // the search starts close to the solution
+#define LK_EPSILON 0.03
+
+#define MIN_EIGEN_THRESHOLD 5e-4 // optical flow drops points with a weaker minimal eigenvalue
+#define MAX_LK_ERROR 30.f // mean absolute patch difference above which a point is dropped
+#define QUALITY_RADIUS 3
+#define MIN_CORNER_QUALITY 4.f // minimal eigenvalue of the structure tensor per pixel
+#define SATURATED_CORNER_QUALITY 100.f
+#define VOTE_WEIGHT_SCALE 4 // weight of a perfect correspondence
+#define COVERAGE_RADIUS 5 // px around a feature in which no other feature is added
+
+#define COARSE_SCALE 0.5f // of the coarse level, one pyrDown
+#define MIN_COARSE_SUPPORT 0.5f // share of the vote weight at the peak below which the full resolution refines
+#define MIN_COARSE_BOX_SIZE 64 // px, shorter side of boxes that are always refined
+#define REFINE_PYRAMID_LEVELS 1 // the refinement starts at the coarse estimate
+
+#define MIN_FEATURE_RATIO 0.25f // of the configured number of features the adaptive budget may shrink to
+#define MIN_FEATURES 8
+#define DOMINANT_SUPPORT 0.7f // share of the vote weight at the peak above which the budget shrinks
+#define WEAK_SUPPORT 0.4f // and below which it grows
+#define FEATURE_SHRINK 0.9f
+#define FEATURE_GROWTH 1.5f
+#define SUPPORT_SMOOTHING 0.2f // weight of the latest frame in the average support
+#define SUPPORT_DROP 0.75f // of the average support below which the correction is triggered
+#define MIN_SUPPORT 0.3f // share of the vote weight at the peak below which the correction is always triggered
+#define MIN_WEAK_CORRECTION_INTERVAL 5 // frames between a correction and the next one a weak estimate may trigger
+#define MAX_RIM_PENALTY 0.25f // weight of rim points moving with the box relative to the support
+#define RIM_TOLERANCE 1.f // px between a rim point and the estimated transform of it
+
+#define REDUCED_FEATURE_RATIO 0.5f // of the features that are left from QUALITY_FEWER_FEATURES on
 
 OFTracker::OFTracker()
 :
 nfeatures(200),
+max_features(200),
 hough(NULL),
+estimator(NULL),
+detector(createCornerDetector(DETECTOR_SHI_TOMASI)),
+features(NULL),
 mask(Mask()),
 gray(cv::Mat()),
 prev_gray(cv::Mat()),
 win_size(10, 10),
-term_crit(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 40, 0.03),
+term_crit(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, LK_ITERATIONS, LK_EPSILON),
+pyramid_levels(PYRAMID_LEVELS),
+prediction(0, 0, 0),
+prediction_center(0, 0),
 initialized(false),
 use_correction(false),
+use_refinement(false),
+adaptive_features(false),
+quality(QUALITY_FULL),
+costs(),
+frame_support(0),
+average_support(0),
+coarse_to_fine(false),
+estimator_type(ESTIMATOR_HOUGH),
+detector_type(DETECTOR_SHI_TOMASI),
 correct_in_X_frames(0),
-num_of_non_correction_frames(0)
+num_of_non_correction_frames(0),
+frames_since_correction(0)
 {
 }
 
 OFTracker::~OFTracker()
 {
 	deInit();
+	delete detector;
 }
 
 /*
 * Configures the tracker.
+* With use_correction the box is corrected whenever the support of the estimate drops or points
+* of the rim move along with the box, and at the latest after non_correction_steps frames if that is positive.
 * Can be called at any time.
 */
 void OFTracker::configure(int n, bool use_correction, int non_correction_steps)
 {
-	nfeatures = n;
+	max_features = n;
+	nfeatures = featureLimit();
 	
 	this->use_correction = use_correction;
 
@@ -46,15 +109,29 @@ void OFTracker::configure(int n, bool use_correction, int non_correction_steps)
 */
 void OFTracker::init(cv::Mat &frame)
 {
-	mask.init(frame.size());
-	cv::cvtColor(frame, gray, CV_BGR2GRAY);
-	cv::cvtColor(frame, prev_gray, CV_BGR2GRAY);
-	
-	this->frame = frame;
+	cv::Mat input = frame;
+	if (coarse_to_fine)
+	{
+		cv::pyrDown(frame, input);
+		fine_mask.init(frame.size());
+		fine_prev_frame = frame;
+	}
+
+	mask.init(input.size());
+	cv::cvtColor(input, gray, CV_BGR2GRAY);
+	cv::cvtColor(input, prev_gray, CV_BGR2GRAY);
 	
 	hough = new HoughHash();
+	hough->setRefinement(use_refinement);
+	hough->setCoarseBins(quality >= QUALITY_COARSE_BINS);
+	hough->setDecoupled(estimator_type == ESTIMATOR_DECOUPLED);
+	estimator = (estimator_type == ESTIMATOR_RANSAC) ? static_cast<RigidEstimator*>(new RansacEstimator()) : hough;
+	predictor.reset();
 
 	correct_in_X_frames = num_of_non_correction_frames;
+	frames_since_correction = 0;
+	frame_support = 0;
+	average_support = 0;
 	initialized = true;
 }
 
@@ -65,7 +142,116 @@ void OFTracker::init(cv::Mat &frame)
 void OFTracker::init(cv::Mat &frame, FlowBox &bb)
 {
     OFTracker::init(frame);
-    setMask(bb);
+    FlowBox box = coarse_to_fine ? scaleBox(bb, COARSE_SCALE) : bb;
+    setMask(box);
+    predictor.update(box);
+}
+
+/*
+* Starts over at bb in frame, e.g. after the box was moved by hand.
+* The estimators and buffers are kept, only a changed frame size or resolution mode initialises again.
+*/
+void OFTracker::retarget(cv::Mat &frame, FlowBox &bb)
+{
+	cv::Size size = coarse_to_fine ? cv::Size((frame.cols + 1) / 2, (frame.rows + 1) / 2) : frame.size();
+	if (!initialized || mask.mask.size() != size || (coarse_to_fine && fine_mask.mask.size() != frame.size()))
+	{
+		reset();
+		init(frame, bb);
+		return;
+	}
+
+	cv::Mat input = frame;
+	FlowBox box = bb;
+	if (coarse_to_fine)
+	{
+		cv::pyrDown(frame, input);
+		box = scaleBox(bb, COARSE_SCALE);
+		fine_prev_frame = frame;
+	}
+
+	// gray may be shared with the FeatureMap, so it is not written in place
+	gray = cv::Mat();
+	cv::cvtColor(input, gray, CV_BGR2GRAY);
+	prev_gray = gray.clone();
+
+	setMask(box);
+	predictor.reset();
+	predictor.update(box);
+
+	correct_in_X_frames = num_of_non_correction_frames;
+	frames_since_correction = 0;
+	frame_support = 0;
+	average_support = 0;
+
+	restart();
+}
+
+/*
+* Stores what is needed to continue tracking from the current frame.
+* Images are only shared, so the state stays valid while the tracker moves on.
+*/
+void OFTracker::saveState(TrackerState &state) const
+{
+	// grays of the FeatureMap are never written again, grays converted here are reused by setFrame()
+	if (features && features->gray().data == gray.data)
+		state.gray = gray;
+	else
+		state.gray = gray.clone();
+
+	state.fine_frame = fine_prev_frame;
+	state.predictor = predictor;
+	state.prediction = prediction;
+	state.prediction_center = prediction_center;
+	state.correct_in_X_frames = correct_in_X_frames;
+	state.frames_since_correction = frames_since_correction;
+	state.frame_support = frame_support;
+	state.average_support = average_support;
+	state.nfeatures = nfeatures;
+	state.coarse_to_fine = coarse_to_fine;
+	state.points.clear();
+	state.values.clear();
+
+	savePoints(state);
+}
+
+/*
+* Continues tracking from a state saved by a tracker of the same type and settings.
+* Returns false if the state does not fit, the tracker is unchanged then.
+*/
+bool OFTracker::restoreState(const TrackerState &state)
+{
+	if (!initialized || state.coarse_to_fine != coarse_to_fine || state.gray.size() != mask.mask.size())
+		return false;
+	if (coarse_to_fine && state.fine_frame.size() != fine_mask.mask.size())
+		return false;
+	if (!restorePoints(state))
+		return false;
+
+	// setFrame() may convert into this buffer later, the one of the state must stay untouched
+	gray = state.gray.clone();
+	fine_prev_frame = state.fine_frame;
+	predictor = state.predictor;
+	prediction = state.prediction;
+	prediction_center = state.prediction_center;
+	correct_in_X_frames = state.correct_in_X_frames;
+	frames_since_correction = state.frames_since_correction;
+	frame_support = state.frame_support;
+	average_support = state.average_support;
+	nfeatures = state.nfeatures;
+
+	// the window of the saved frame, until next() predicts the following one
+	estimator->setRotationWindow(prediction.z, predictor.rotationRange());
+
+	return true;
+}
+
+size_t TrackerState::bytes() const
+{
+	size_t n = gray.total() * gray.elemSize() + fine_frame.total() * fine_frame.elemSize();
+	for (size_t i = 0; i < points.size(); i++)
+		n += points[i].capacity() * sizeof(cv::Point2f);
+	return n + values.size() * sizeof(int) + sizeof(*this);
 }
 
 void OFTracker::deInit()
@@ -74,6 +260,8 @@ void OFTracker::deInit()
 
 	gray.release();
 	prev_gray.release();
+	fine_prev_frame.release();
+	if (estimator != hough) delete estimator;
 	delete hough;
 
 	initialized = false;
@@ -89,6 +277,116 @@ bool OFTracker::isInitialized() const
 	return initialized;
 }
 
+/*
+* Enables the least squares refinement of the HoughHash peak.
+* Can be called at any time.
+*/
+void OFTracker::setRefinement(bool enabled)
+{
+	use_refinement = enabled;
+	if (initialized) hough->setRefinement(use_refinement);
+}
+
+/*
+* Lets the number of features follow the confidence of the estimated transform: it shrinks while the peak
+* dominates and grows when the support weakens or the correction moves the box, between a quarter of
+* the configured number and the configured number itself.
+* Can be called at any time.
+*/
+void OFTracker::setAdaptiveFeatures(bool enabled)
+{
+	adaptive_features = enabled;
+	if (!adaptive_features) nfeatures = featureLimit();
+}
+
+/*
+* Trades accuracy for speed, from QUALITY_FULL (default) down to QUALITY_LOWEST.
+* Every level keeps the savings of the levels above it:
+* half the features, no correction, coarser HoughHash bins, one optical flow pyramid level less.
+* Can be called at any time.
+*/
+void OFTracker::setQuality(int level)
+{
+	quality = std::max(QUALITY_FULL, std::min(QUALITY_LOWEST, level));
+
+	nfeatures = adaptive_features ? std::min(nfeatures, featureLimit()) : featureLimit();
+	if (initialized) hough->setCoarseBins(quality >= QUALITY_COARSE_BINS);
+}
+
+const StageCosts & OFTracker::getStageCosts() const
+{
+	return costs;
+}
+
+/*
+* Share of the vote weight at the peak of the estimator in the last call of next()
+*/
+float OFTracker::getSupport() const
+{
+	return frame_support;
+}
+
+/*
+* Largest number of features at the current quality
+*/
+int OFTracker::featureLimit() const
+{
+	if (quality < QUALITY_FEWER_FEATURES) return max_features;
+	return std::max(1, cvRound(REDUCED_FEATURE_RATIO * max_features));
+}
+
+/*
+* Tracks on half the resolution and only refines at full resolution if the coarse transform
+* has little support or the box is small. Boxes passed in and out stay in full resolution.
+* Takes effect with the next init().
+*/
+void OFTracker::setCoarseToFine(bool enabled)
+{
+	coarse_to_fine = enabled;
+}
+
+/*
+* Selects the estimator of the per frame transform, ESTIMATOR_HOUGH (default), ESTIMATOR_DECOUPLED or ESTIMATOR_RANSAC.
+* The correction always uses the HoughHash.
+* Can be called at any time.
+*/
+void OFTracker::setEstimator(int type)
+{
+	if (initialized && type != estimator_type)
+	{
+		if (estimator != hough) delete estimator;
+		estimator = (type == ESTIMATOR_RANSAC) ? static_cast<RigidEstimator*>(new RansacEstimator()) : hough;
+		hough->setDecoupled(type == ESTIMATOR_DECOUPLED);
+	}
+
+	estimator_type = type;
+}
+
+/*
+* Selects the corner detector for new features, DETECTOR_SHI_TOMASI (default) or DETECTOR_FAST.
+* Can be called at any time.
+*/
+void OFTracker::setDetector(int type)
+{
+	if (type == detector_type) return;
+
+	delete detector;
+	detector = createCornerDetector(type);
+	detector->setFeatureMap(features);
+	detector_type = type;
+}
+
+/*
+* Shares the gray image and the corner response of each frame with the other trackers using map.
+* Whoever owns map must set each frame on it before passing the frame to next().
+* NULL detaches the tracker again.
+*/
+void OFTracker::setFeatureMap(FeatureMap *map)
+{
+	features = map;
+	detector->setFeatureMap(map);
+}
+
 bool OFTracker::setMask(const FlowBox &bb)
 {
 	if(!initialized) return false;
@@ -102,12 +400,13 @@ bool OFTracker::setFrame(cv::Mat &frame)
 {
 	if(!initialized) return false;
 	
-	this->frame = frame;
-	
 	cv::Mat tmp;
 	CV_SWAP(prev_gray, gray, tmp);
 	
-	cv::cvtColor(frame, gray, CV_BGR2GRAY);
+	if (features && features->gray().size() == frame.size())
+		gray = features->gray();
+	else
+		cv::cvtColor(frame, gray, CV_BGR2GRAY);
 	
 	return true;
 }
@@ -123,49 +422,74 @@ bool OFTracker::findFeatures(Points &points, bool masked)
 	if (masked) msk = mask.mask;
 	else msk = cv::Mat();
 	
-	double quality = 0.01;
-	double min_distance = 3;
+	detector->detectInRegion(gray, points, msk, masked ? mask.roi : cv::Rect(0, 0, gray.cols, gray.rows), nfeatures);
 
-	cv::goodFeaturesToTrack(gray, points, nfeatures, quality, min_distance, msk, 3, 0, 0.04);
+	return points.size() != 0;
+}
 
-	if (points.size() == 0) return false;
-	
-	cv::cornerSubPix(gray, points, win_size, cv::Size(-1,-1), term_crit);
-	return true;
+/*
+* Detects up to max_count more features in the area defined by our mask that isn't covered by points yet
+* and appends them to points. previous selects the frame before the current one as the frame points belong to.
+* Returns the number of added features.
+*/
+int OFTracker::addFeatures(Points &points, int max_count, bool previous)
+{
+	if(!initialized || max_count <= 0) return 0;
+
+	mask.mask.copyTo(uncovered);
+	for(int i = 0; i < static_cast<int>(points.size()); i++)
+		cv::circle(uncovered, cv::Point(cvRound(points[i].x), cvRound(points[i].y)), COVERAGE_RADIUS, cv::Scalar(0), -1);
+
+	Points found;
+	detector->detectInRegion(previous ? prev_gray : gray, found, uncovered, mask.roi, max_count);
+
+	points.insert(points.end(), found.begin(), found.end());
+	return static_cast<int>(found.size());
 }
+
 /*
-* Calculates the movement of all features in the bounding box between the current and previous step
+* Calculates the movement of all features in the bounding box between the current and previous step.
+* The search starts at the position predicted by the motion model.
 */
-bool OFTracker::trackFeatures(Points &points_old, Points &points_new, Errors &error, Statuses &status)
+bool OFTracker::trackFeatures(Points &points_old, Points &points_new, Statuses &status, Errors &error)
 {
 	if(!initialized) return false;
 
-	//hack, remove if possible
-	cv::Mat in(points_old), out(points_new);
-	cv::Mat stat(status);
-	cv::Mat err(error);
-	
-	cv::calcOpticalFlowPyrLK(prev_gray, gray, in, out, stat, err, win_size, 3, term_crit, 0);
+	float a = prediction.z * float(M_PI) / 180;
+	float cosa = cos(a), sina = sin(a);
 
-	if(points_new.size() != points_old.size()) points_new.resize(points_old.size());
+	// same model as the HoughHash: A*(p - c) + t = p' - c
+	points_new.resize(points_old.size());
 	for(int i = 0; i < static_cast<int>(points_old.size()); i++)
 	{
-		points_new[i] = out.at<cv::Point2f>(i);
-		status[i] = stat.at<char>(i);
+		cv::Point2f p = points_old[i] - prediction_center;
+		points_new[i] = cv::Point2f(cosa * p.x + sina * p.y + prediction.x, -sina * p.x + cosa * p.y + prediction.y) + prediction_center;
 	}
 
-	removeOutliers(points_new, status);
+	cv::calcOpticalFlowPyrLK(prev_gray, gray, points_old, points_new, status, error, win_size, pyramid_levels, term_crit,
+		cv::OPTFLOW_USE_INITIAL_FLOW, MIN_EIGEN_THRESHOLD);
+
+	removeOutliers(points_new, status, error);
 	return true;
 }
 
+/*
+* Checks if p lies inside the current bounding box
+*/
+bool OFTracker::insideBox(const cv::Point2f &p)
+{
+	return mask.getValue(p) == INSIDE_FlowBox;
+}
+
 /*
 * Removes all points that lie outside of the bounding box from the mask
+* and all points the optical flow couldn't match well enough
 */
-void OFTracker::removeOutliers(Points &points, Statuses &status)
+void OFTracker::removeOutliers(Points &points, Statuses &status, Errors &error)
 {
 	for(int i = 0; i < static_cast<int>(points.size()); i++)
 	{
-		if(!status[i] || points[i].x >= gray.cols || points[i].x < 0 || points[i].y >= gray.rows || points[i].y < 0)
+		if(!status[i] || error[i] > MAX_LK_ERROR || points[i].x >= gray.cols || points[i].x < 0 || points[i].y >= gray.rows || points[i].y < 0)
 		{
 			points[i] = cvPoint2D32f(-1, -1);
 			status[i] = 0;
@@ -174,46 +498,328 @@ void OFTracker::removeOutliers(Points &points, Statuses &status)
 }
 
 /*
-* Calculates the position and orientation of the bounding box for the next frame using the HoughHash
-* and the optical flow of all features determined by track() and trackFeatures(). If enabled, correction
-* is performed afterwards.
-* This is where all the interesting stuff either happens or is initiated from.
+* Moves bb into frame, which is span frames after the previous one, with the estimator
+* on the optical flow of the features, and corrects it afterwards if enabled.
+* Prediction and correction interval count in frames, so they are not affected by the span.
 */
-void OFTracker::next(cv::Mat &frame, FlowBox &bb)
+void OFTracker::next(cv::Mat &frame, FlowBox &bb, int span)
 {
 	if (!initialized) return;
 
 	cv::Point2f p1, p2;
-	cv::Point2f center = bb.getRotationCenter();
+	float error;
+	cv::Mat input = frame;
+	FlowBox box = bb;
+
+	if (coarse_to_fine)
+	{
+		cv::pyrDown(frame, input);
+		box = scaleBox(bb, COARSE_SCALE);
+	}
 
-	setMask(bb);
-	setFrame(frame);
+	cv::Point2f center = box.getRotationCenter();
+	double ms = 1000 / cv::getTickFrequency();
+	int64 start = cv::getTickCount();
+
+	predict(box, span);
+	setMask(box);
+	setFrame(input);
 	track();
-	
-	hough->reset();
 
-	int i = 0;
+	int64 tracked = cv::getTickCount();
+	costs.track = (tracked - start) * ms;
+	
+	votes_from.clear();
+	votes_to.clear();
+	votes_weights.clear();
+	rim_from.clear();
+	rim_to.clear();
+	rim_weights.clear();
 
 	//iterate through point moves
-	while(iteratePoints(p1, p2)) 
+	while(iteratePoints(p1, p2, error)) 
 	{
-		if (mask.getValue(p1) == INSIDE_FlowBox && mask.getValue(p2))
+		char c = mask.getValue(p1);
+		if (!c || !mask.getValue(p2)) continue;
+
+		// the rim only matters for the decision to correct
+		if (c == INSIDE_RIM && !use_correction) continue;
+
+		int weight = voteWeight(p2, error);
+		if (!weight) continue;
+
+		if (c == INSIDE_FlowBox)
 		{
-			hough->fill(p1 - center, p2 - center, 1);
-			i++;
+			votes_from.push_back(p1 - center);
+			votes_to.push_back(p2 - center);
+			votes_weights.push_back(weight);
+		}
+		else
+		{
+			rim_from.push_back(p1 - center);
+			rim_to.push_back(p2 - center);
+			rim_weights.push_back(weight);
 		}
 	}
 
-	if(i) bb.applyTransform(hough->getMaxTransform());
+	int score = 0, total = 0;
+	for (int i = 0; i < static_cast<int>(votes_weights.size()); i++) total += votes_weights[i];
 
-	if(use_correction)
+	cv::Point3f T(0, 0, 0);
+	if(!votes_from.empty())
+	{
+		T = estimator->estimate(votes_from, votes_to, votes_weights, &score);
+		box.applyTransform(T);
+	}
+
+	float support = total ? static_cast<float>(score) / total : 0;
+	frame_support = support;
+	float penalty = score ? static_cast<float>(rimSupport(T)) / score : 0;
+
+	if (coarse_to_fine)
+	{
+		FlowBox previous = bb;
+		bb = scaleBox(box, 1 / COARSE_SCALE);
+
+		if (score < MIN_COARSE_SUPPORT * total || std::min(bb.w, bb.h) < MIN_COARSE_BOX_SIZE)
+		{
+			refine(frame, previous, bb);
+			box = scaleBox(bb, COARSE_SCALE);
+		}
+
+		fine_prev_frame = frame;
+	}
+
+	int64 estimated = cv::getTickCount();
+	costs.estimate = (estimated - tracked) * ms;
+
+	bool corrected = false;
+	if(use_correction && quality < QUALITY_NO_CORRECTION)
 	{
-		correct_in_X_frames--;
+		correct_in_X_frames -= span;
+		frames_since_correction += span;
 
-		if (correct_in_X_frames == 0)
+		// the fixed interval only bounds the time between two corrections, 0 disables it.
+		// Objects with little texture stay weak, they would be corrected in every frame without a minimal interval.
+		bool weak = support < MIN_SUPPORT || support < SUPPORT_DROP * average_support || penalty > MAX_RIM_PENALTY;
+		weak = weak && frames_since_correction >= MIN_WEAK_CORRECTION_INTERVAL;
+
+		if ((num_of_non_correction_frames > 0 && correct_in_X_frames <= 0) || (weak && !votes_from.empty()))
 		{
-			correct(bb);
+			FlowBox before = box;
+			correct(box);
+			corrected = box.x != before.x || box.y != before.y || box.phi != before.phi;
 			correct_in_X_frames = num_of_non_correction_frames;
+			frames_since_correction = 0;
 		}
 	}
+
+	average_support = average_support ? (1 - SUPPORT_SMOOTHING) * average_support + SUPPORT_SMOOTHING * support : support;
+
+	costs.correct = (cv::getTickCount() - estimated) * ms;
+
+	if (adaptive_features && total) adaptBudget(support, corrected);
+
+	predictor.update(box, span);
+	bb = coarse_to_fine ? scaleBox(box, 1 / COARSE_SCALE) : box;
+}
+
+/*
+* Weight of the rim points that move along with the box under T.
+* Points outside the box that follow it suggest that the box doesn't cover the object.
+*/
+int OFTracker::rimSupport(const cv::Point3f &T) const
+{
+	int weight = 0;
+	float tolerance2 = RIM_TOLERANCE * RIM_TOLERANCE;
+
+	for (int i = 0; i < static_cast<int>(rim_from.size()); i++)
+	{
+		cv::Point2f d = applyRigidTransform(T, rim_from[i]) - rim_to[i];
+		if (d.x * d.x + d.y * d.y <= tolerance2) weight += rim_weights[i];
+	}
+
+	return weight;
+}
+
+/*
+* Estimates the transform from previous to bb again at full resolution.
+* Features of the previous box are detected in the previous frame and followed into frame,
+* starting at the positions bb predicts.
+*/
+void OFTracker::refine(const cv::Mat &frame, const FlowBox &previous, FlowBox &bb)
+{
+	if (fine_prev_frame.size() != frame.size()) return;
+
+	cv::Mat fine_prev_gray, fine_gray;
+	cv::cvtColor(fine_prev_frame, fine_prev_gray, CV_BGR2GRAY);
+	if (features && features->gray().size() == frame.size())
+		fine_gray = features->gray();
+	else
+		cv::cvtColor(frame, fine_gray, CV_BGR2GRAY);
+
+	Points from, to;
+	fine_mask.set(previous);
+	detector->detectInRegion(fine_prev_gray, from, fine_mask.mask, fine_mask.roi, nfeatures);
+	if (from.empty()) return;
+
+	// same model as the HoughHash: A*(p - c) + t = p' - c
+	cv::Point2f center = previous.getRotationCenter();
+	cv::Point2f t = bb.getRotationCenter() - center;
+	float da = bb.phi - previous.phi;
+	float a = da * float(M_PI) / 180;
+	float cosa = cos(a), sina = sin(a);
+
+	to.resize(from.size());
+	for (int i = 0; i < static_cast<int>(from.size()); i++)
+	{
+		cv::Point2f p = from[i] - center;
+		to[i] = cv::Point2f(cosa * p.x + sina * p.y + t.x, -sina * p.x + cosa * p.y + t.y) + center;
+	}
+
+	Statuses status;
+	Errors error;
+	cv::calcOpticalFlowPyrLK(fine_prev_gray, fine_gray, from, to, status, error, win_size, REFINE_PYRAMID_LEVELS, term_crit,
+		cv::OPTFLOW_USE_INITIAL_FLOW, MIN_EIGEN_THRESHOLD);
+
+	Points moved_from, moved_to;
+	Weights weights;
+	for (int i = 0; i < static_cast<int>(from.size()); i++)
+	{
+		if (!status[i] || error[i] > MAX_LK_ERROR || fine_mask.getValue(to[i]) == 0) continue;
+
+		moved_from.push_back(from[i] - center);
+		moved_to.push_back(to[i] - center);
+		weights.push_back(std::max(1, cvRound(VOTE_WEIGHT_SCALE * (1 - error[i] / MAX_LK_ERROR))));
+	}
+
+	if (moved_from.empty()) return;
+
+	bb = previous;
+	bb.applyTransform(estimator->estimate(moved_from, moved_to, weights));
+}
+
+/*
+* Adjusts the number of features to the share of the vote weight at the peak of the last transform
+*/
+void OFTracker::adaptBudget(float support, bool corrected)
+{
+	int max_count = featureLimit();
+	int min_features = std::min(max_count, std::max(MIN_FEATURES, cvRound(MIN_FEATURE_RATIO * max_features)));
+
+	if (corrected || support < WEAK_SUPPORT)
+		nfeatures = cvCeil(nfeatures * FEATURE_GROWTH);
+	else if (support > DOMINANT_SUPPORT)
+		nfeatures = cvFloor(nfeatures * FEATURE_SHRINK);
+
+	nfeatures = std::max(min_features, std::min(max_count, nfeatures));
+}
+
+/*
+* Scales position and size of bb, e.g. into the coarse level
+*/
+FlowBox OFTracker::scaleBox(const FlowBox &bb, float scale)
+{
+	return FlowBox(bb.x * scale, bb.y * scale, bb.w * scale, bb.h * scale, bb.phi);
+}
+
+/*
+* Weight of the vote of a point tracked to p with the given optical flow error:
+* good matches of strong corners count up to VOTE_WEIGHT_SCALE times,
+* weak corners don't vote at all.
+*/
+int OFTracker::voteWeight(const cv::Point2f &p, float error) const
+{
+	if (error > MAX_LK_ERROR) return 0;
+
+	float quality = cornerQuality(p);
+	if (quality < MIN_CORNER_QUALITY) return 0;
+
+	float w = VOTE_WEIGHT_SCALE * (1 - error / MAX_LK_ERROR) * std::min(1.f, quality / SATURATED_CORNER_QUALITY);
+	return std::max(1, std::min(VOTE_WEIGHT_SCALE, cvRound(w)));
+}
+
+/*
+* Smaller eigenvalue of the structure tensor around p in the current frame, per pixel.
+* Same measure goodFeaturesToTrack ranks corners by.
+*/
+float OFTracker::cornerQuality(const cv::Point2f &p) const
+{
+	int x0 = static_cast<int>(p.x), y0 = static_cast<int>(p.y);
+
+	if (x0 - QUALITY_RADIUS < 1 || y0 - QUALITY_RADIUS < 1 ||
+		x0 + QUALITY_RADIUS >= gray.cols - 1 || y0 + QUALITY_RADIUS >= gray.rows - 1) return 0;
+
+	float a = 0, b = 0, c = 0;
+	for (int y = y0 - QUALITY_RADIUS; y <= y0 + QUALITY_RADIUS; y++)
+	{
+		const uchar *row = gray.ptr<uchar>(y);
+		const uchar *up = gray.ptr<uchar>(y - 1);
+		const uchar *down = gray.ptr<uchar>(y + 1);
+
+		for (int x = x0 - QUALITY_RADIUS; x <= x0 + QUALITY_RADIUS; x++)
+		{
+			float dx = 0.5f * (row[x + 1] - row[x - 1]);
+			float dy = 0.5f * (down[x] - up[x]);
+			a += dx * dx;
+			b += dx * dy;
+			c += dy * dy;
+		}
+	}
+
+	float n = static_cast<float>((2 * QUALITY_RADIUS + 1) * (2 * QUALITY_RADIUS + 1));
+	a /= n;
+	b /= n;
+	c /= n;
+
+	return 0.5f * (a + c) - std::sqrt(0.25f * (a - c) * (a - c) + b * b);
+}
+
+/*
+* Prepares the current frame, span frames after the previous one, for the predicted motion of bb:
+* seeds the optical flow, centers the rotation window of the HoughHash
+* and sizes the optical flow for bb and the motion the prediction may miss.
+*/
+void OFTracker::predict(const FlowBox &bb, int span)
+{
+	if (predictor.isEmpty()) predictor.update(bb);
+
+	prediction = predictor.predict(span);
+	prediction_center = bb.getRotationCenter();
+
+	estimator->setRotationWindow(prediction.z, predictor.rotationRange(span));
+	adaptFlow(bb, span);
+}
+
+/*
+* Derives window, pyramid levels and iterations of the optical flow from the size of bb and the residual motion.
+* The window grows with the box, the levels are just enough to cover the displacement the prediction
+* may miss with half a window on the coarsest level.
+*/
+void OFTracker::adaptFlow(const FlowBox &bb, int span)
+{
+	int side = cvRound(WINDOW_BOX_RATIO * std::min(bb.w, bb.h));
+	side = std::max(MIN_WINDOW_SIZE, std::min(MAX_WINDOW_SIZE, side));
+	win_size = cv::Size(side, side);
+
+	float residual = predictor.residual(0.5f * std::sqrt(bb.w * bb.w + bb.h * bb.h), span);
+	if (residual < 0)
+	{
+		pyramid_levels = PYRAMID_LEVELS;
+	}
+	else
+	{
+		// each level doubles the reach of the window
+		float reach = 0.5f * side;
+		pyramid_levels = 0;
+		while (reach < residual && pyramid_levels < MAX_PYRAMID_LEVELS)
+		{
+			reach *= 2;
+			pyramid_levels++;
+		}
+	}
+
+	if (quality >= QUALITY_FEWER_LEVELS) pyramid_levels = std::max(0, pyramid_levels - 1);
+
+	term_crit.maxCount = predictor.isSteady() ? STEADY_LK_ITERATIONS : LK_ITERATIONS;
 }
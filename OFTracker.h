@@ -1,37 +1,114 @@
 #pragma once
 #include <opencv2/core/core.hpp>
 
+#include "CornerDetector.h"
 #include "FlowBox.h"
 #include "HoughHash.h"
 #include "Mask.h"
+#include "MotionPredictor.h"
 
-typedef std::vector<cv::Point2f> Points;
-typedef std::vector<char> Errors;
-typedef std::vector<float> Statuses;
+typedef std::vector<float> Errors;
+typedef std::vector<uchar> Statuses;
+
+// quality levels, each one includes the savings of the levels above
+#define QUALITY_FULL 0
+#define QUALITY_FEWER_FEATURES 1
+#define QUALITY_NO_CORRECTION 2
+#define QUALITY_COARSE_BINS 3
+#define QUALITY_FEWER_LEVELS 4
+#define QUALITY_LOWEST QUALITY_FEWER_LEVELS
+
+/*
+* Time (in ms) the stages of the last call of next() took
+*/
+struct StageCosts
+{
+	double track; // frame preparation, detection and optical flow
+	double estimate; // transform estimation including the full resolution refinement
+	double correct;
+};
+
+/*
+* Everything a tracker needs to continue from the frame it was saved at
+*/
+struct TrackerState
+{
+	cv::Mat gray; // of the frame the state was saved at
+	cv::Mat fine_frame; // full resolution image of the coarse to fine mode
+	MotionPredictor predictor;
+	cv::Point3f prediction;
+	cv::Point2f prediction_center;
+	int correct_in_X_frames;
+	int frames_since_correction;
+	float frame_support;
+	float average_support;
+	int nfeatures;
+	bool coarse_to_fine;
+	std::vector<Points> points; // point sets of the subclass
+	std::vector<int> values; // counters and flags of the subclass
+
+	size_t bytes() const;
+};
 
 class OFTracker
 {
 protected:
-	int nfeatures;
+	int nfeatures; // current budget
+	int max_features; // configured number of features
 	HoughHash * hough;
+	RigidEstimator * estimator; // the hough itself unless another estimator is selected
+	CornerDetector * detector;
+	FeatureMap * features; // shared with other trackers, not owned
 
 private:
 	Mask mask;
-	cv::Mat frame;
+	Mask fine_mask; // full resolution mask of the coarse to fine mode
 	cv::Mat gray, prev_gray;
+	cv::Mat fine_prev_frame; // previous full resolution frame of the coarse to fine mode
 	cv::Size win_size;
 	cv::TermCriteria term_crit;
+	int pyramid_levels;
+	MotionPredictor predictor;
+	cv::Point3f prediction; // expected transform of the current frame
+	cv::Point2f prediction_center; // rotation center the prediction refers to
+	Points votes_from, votes_to; // correspondences relative to the rotation center
+	Weights votes_weights;
+	Points rim_from, rim_to; // correspondences in the rim around the box
+	Weights rim_weights;
+	cv::Mat uncovered; // mask without the neighbourhoods of existing features
 	bool initialized;
 	bool use_correction;
+	bool use_refinement;
+	bool adaptive_features;
+	int quality;
+	StageCosts costs;
+	float frame_support; // share of the vote weight at the peak in the last frame
+	float average_support; // share of the vote weight at the peak, averaged over recent frames
+	bool coarse_to_fine;
+	int estimator_type;
+	int detector_type;
 	int correct_in_X_frames;
 	int num_of_non_correction_frames;
+	int frames_since_correction; // bounds how often weak estimates trigger a correction
 
 public:
 	virtual ~OFTracker();
 	virtual void init(cv::Mat &frame);
 	virtual void init(cv::Mat &frame, FlowBox &bb);
 	bool isInitialized() const;
-	void next(cv::Mat &frame, FlowBox &bb);
+	void setRefinement(bool enabled);
+	void setCoarseToFine(bool enabled);
+	void setAdaptiveFeatures(bool enabled);
+	void setQuality(int level);
+	const StageCosts & getStageCosts() const;
+	float getSupport() const;
+	void setEstimator(int type);
+	void setDetector(int type);
+	void setFeatureMap(FeatureMap *map);
+	void next(cv::Mat &frame, FlowBox &bb, int span = 1);
+	void retarget(cv::Mat &frame, FlowBox &bb);
+	void saveState(TrackerState &state) const;
+	bool restoreState(const TrackerState &state);
 	virtual void reset();
 
 protected:
@@ -41,13 +118,27 @@ protected:
 	
 	bool setFrame(cv::Mat &frame);
 	bool findFeatures(Points &points, bool masked);
-	bool trackFeatures(Points &points_old, Points &points_new, Errors &error, Statuses &status);
+	int addFeatures(Points &points, int max_count, bool previous);
+	bool trackFeatures(Points &points_old, Points &points_new, Statuses &status, Errors &error);
+	bool insideBox(const cv::Point2f &p);
 	virtual void correct(FlowBox &bb) = 0;
 	virtual bool track() = 0;
-	virtual bool iteratePoints(cv::Point2f &p1, cv::Point2f &p2) = 0;
+	virtual void restart() = 0;
+	virtual void savePoints(TrackerState &state) const = 0;
+	virtual bool restorePoints(const TrackerState &state) = 0;
+	virtual bool iteratePoints(cv::Point2f &p1, cv::Point2f &p2, float &error) = 0;
 	
 private:
 	void deInit();
-	void removeOutliers(Points &newp, Statuses &status);
+	void removeOutliers(Points &newp, Statuses &status, Errors &error);
+	int voteWeight(const cv::Point2f &p, float error) const;
+	float cornerQuality(const cv::Point2f &p) const;
 	bool setMask(const FlowBox &bb);
+	void predict(const FlowBox &bb, int span);
+	void adaptFlow(const FlowBox &bb, int span);
+	void adaptBudget(float support, bool corrected);
+	int featureLimit() const;
+	int rimSupport(const cv::Point3f &T) const;
+	void refine(const cv::Mat &frame, const FlowBox &previous, FlowBox &bb);
+	static FlowBox scaleBox(const FlowBox &bb, float scale);
 };
@@ -1,4 +1,5 @@
 #include "OverlapOFTracker.h"
+#include <algorithm>
 #include <random>
 #define NUM_MODELS 40
 #define MODEL_VARIANCE_XY 10
@@ -6,13 +7,12 @@
 
 OverlapOFTracker::OverlapOFTracker()
 :
-correctionMask(Mask()),
 sets(0),
-points(NULL),
-status(NULL),
-error(NULL),
 counter(0),
-iterator_initialized(false)
+iterator_initialized(false),
+iterator_pos(0),
+iterator_set(0),
+iterator_pnt(0)
 {
 }
 
@@ -21,10 +21,17 @@ OverlapOFTracker::~OverlapOFTracker()
 	deInit();
 }
 
+/*
+* Can be called at any time. A new number of future steps starts the sets over in the current frame.
+*/
 void OverlapOFTracker::configure(int future_steps, int non_correction_steps, int features, bool ncs_enabled)
 {
+	bool reshape = isInitialized() && future_steps != sets;
+
 	sets = future_steps;
 	OFTracker::configure(features/future_steps, ncs_enabled, non_correction_steps);
+
+	if (reshape) restart();
 }
 
 /*
@@ -32,59 +39,17 @@ void OverlapOFTracker::configure(int future_steps, int non_correction_steps, int
 */
 void OverlapOFTracker::init(cv::Mat &frame)
 {
-	points = new std::vector<cv::Point2f>*[sets];
-	for (int i = 0; i < sets; i++)
-	{
-		points[i] = new std::vector<cv::Point2f>[sets];
-		for (int j = 0; j < sets; j++)
-			points[i][j] = std::vector<cv::Point2f>(nfeatures);
-	}
-    
-	status = new std::vector<char>[sets];
-	for (int i = 0; i < sets; i++){
-		status[i] = std::vector<char>(nfeatures);
-		for(int j = 0; j < nfeatures; j++)
-			status[i][j] = 1;
-	}
-
-	error = new std::vector<float>[sets];
-	for (int i = 0; i < sets; i++)
-		error[i] = std::vector<float>(nfeatures);
-
-	counter = 0;
+	allocate();
 	OFTracker::init(frame);
-	
-	correctionMask.init(frame.size());
 }
 
 /*
 * Initialises points, status and error matrices for each set of overlapping frames
 */
 void OverlapOFTracker::init(cv::Mat &frame, FlowBox &bb) {
-    points = new std::vector<cv::Point2f>*[sets];
-    for (int i = 0; i < sets; i++)
-    {
-        points[i] = new std::vector<cv::Point2f>[sets];
-        for (int j = 0; j < sets; j++)
-            points[i][j] = std::vector<cv::Point2f>(nfeatures);
-    }
-
-    status = new std::vector<char>[sets];
-    for (int i = 0; i < sets; i++){
-        status[i] = std::vector<char>(nfeatures);
-        for(int j = 0; j < nfeatures; j++)
-            status[i][j] = 1;
-    }
-
-    error = new std::vector<float>[sets];
-    for (int i = 0; i < sets; i++)
-        error[i] = std::vector<float>(nfeatures);
-
-    counter = 0;
+    allocate();
     OFTracker::init(frame, bb);
 
-    correctionMask.init(frame.size());
-
     track();
 }
 
@@ -98,13 +63,65 @@ void OverlapOFTracker::deInit()
 {
 	if (!isInitialized()) return;
 	
+	points.clear();
+	status.clear();
+	error.clear();
+}
+
+/*
+* Starts over with empty sets, the buffers of the sets are kept
+*/
+void OverlapOFTracker::allocate()
+{
+	points.resize(sets);
+	status.resize(sets);
+	error.resize(sets);
+
 	for (int i = 0; i < sets; i++)
-		delete[] points[i];
-	delete[] points;
+	{
+		points[i].resize(sets);
+		for (int j = 0; j < sets; j++)
+			points[i][j].clear();
+		status[i].clear();
+		error[i].clear();
+	}
 
-	delete[] status;
-	
-	delete[] error;
+	counter = 0;
+	iterator_initialized = false;
+}
+
+/*
+* Stores the steps of all sets row by row
+*/
+void OverlapOFTracker::savePoints(TrackerState &state) const
+{
+	for (int i = 0; i < sets; i++)
+		state.points.insert(state.points.end(), points[i].begin(), points[i].end());
+	state.values.push_back(sets);
+	state.values.push_back(counter);
+}
+
+bool OverlapOFTracker::restorePoints(const TrackerState &state)
+{
+	if (state.values.size() != 2 || state.values[0] != sets || static_cast<int>(state.points.size()) != sets * sets)
+		return false;
+
+	allocate();
+	for (int i = 0; i < sets; i++)
+		for (int j = 0; j < sets; j++)
+			points[i][j] = state.points[i * sets + j];
+	counter = state.values[1];
+
+	return true;
+}
+
+/*
+* Drops all sets and seeds the first one again in the current frame
+*/
+void OverlapOFTracker::restart()
+{
+	allocate();
+	track();
 }
 
 /*
@@ -116,10 +133,10 @@ bool OverlapOFTracker::track()
 	int pos = counter % sets;
 	int D = (counter > sets) ? sets : counter;
 
-	findFeatures(points[pos][pos], true);
+	seed(pos);
 
 	for (int i = 0; i < D; i++){ // iterate through point sets
-		if (points[i][0].size() > 0){ // number of points in set i
+		if (points[i][(pos - 1 + sets) % sets].size() > 0){ // number of points in set i
 			if (i != pos)
 			{
 				trackFeatures(points[i][(pos - 1 + sets) % sets], points[i][pos], status[i], error[i]);
@@ -131,6 +148,35 @@ bool OverlapOFTracker::track()
 	return true;
 }
 
+/*
+* Fills the set at pos with the features of the current frame.
+* Once all sets are in use the set at pos is the oldest one. Its features that are still tracked well
+* and lie inside the box are tracked one more step and kept, only the area they don't cover is searched
+* for new features. This saves most of the detection on every frame.
+*/
+void OverlapOFTracker::seed(int pos)
+{
+	Points &seeds = points[pos][pos];
+
+	if (counter < sets)
+	{
+		findFeatures(seeds, true);
+		return;
+	}
+
+	trackFeatures(points[pos][(pos - 1 + sets) % sets], seeds, status[pos], error[pos]);
+
+	int live = 0;
+	for (int i = 0; i < static_cast<int>(seeds.size()); i++)
+	{
+		if (status[pos][i] && insideBox(seeds[i]))
+			seeds[live++] = seeds[i];
+	}
+	seeds.resize(std::min(live, nfeatures)); // the budget may have shrunk
+
+	addFeatures(seeds, nfeatures - static_cast<int>(seeds.size()), false);
+}
+
 /*
 * generates random box orientations and checks if they suit they match the features better then the 
 * calculated box for this step from the HoughHash
@@ -146,6 +192,9 @@ void OverlapOFTracker::correct(FlowBox &bb)
 	int max_index = 0;
 	int iterations = 0;
 
+	// older steps are not covered by the predicted rotation window
+	hough->setRotationWindow(0, MAX_ROTATION_ANGLE);
+
 	do
 	{
 		last_max_score = max_score;
@@ -189,15 +238,22 @@ int OverlapOFTracker::scoreModel(FlowBox &bb)
 	{
 		count = 0;
 		hough->reset();
+		inside_from.clear();
+		inside_to.clear();
+		inside_weights.clear();
 		
-		correctionMask.set(bb);
+		labels.clear();
+		labels.add(bb);
 		while(iteratePoints(i, p1, p2))
 		{ 
-			c = correctionMask.getValue(p1);
+			c = labels.getValue(p1);
 
 			if (c == INSIDE_FlowBox)
 			{
 				hough->fill(p1 - img_center, p2 - img_center, 1);
+				inside_from.push_back(p1 - img_center);
+				inside_to.push_back(p2 - img_center);
+				inside_weights.push_back(1);
 				count++;
 			}
 			else
@@ -209,7 +265,7 @@ int OverlapOFTracker::scoreModel(FlowBox &bb)
 		}
 		
 		if (count){
-			bb.applyTransform(hough->getMaxTransform(&tmp_score));
+			bb.applyTransform(hough->getMaxTransform(inside_from, inside_to, inside_weights, &tmp_score));
 
 			tmp_score = std::max(tmp_score, 0);
 			score += static_cast<float>(tmp_score * tmp_score) / count;
@@ -238,9 +294,13 @@ std::vector<FlowBox> OverlapOFTracker::distributeModels(FlowBox &seed)
 /*
 * iterator for the current time
 */
-bool OverlapOFTracker::iteratePoints(cv::Point2f &p1, cv::Point2f &p2)
+bool OverlapOFTracker::iteratePoints(cv::Point2f &p1, cv::Point2f &p2, float &error)
 {
-	return iteratePoints(sets - 2, p1, p2); //sets - 2 is the current position
+	if (!iteratePoints(sets - 2, p1, p2)) return false; //sets - 2 is the current position
+
+	// the errors of each set belong to its latest step
+	error = (iterator_pnt < static_cast<int>(this->error[iterator_set].size())) ? this->error[iterator_set][iterator_pnt] : 0;
+	return true;
 }
 
 /*
@@ -251,30 +311,32 @@ bool OverlapOFTracker::iteratePoints(int rPos, cv::Point2f &p1, cv::Point2f &p2)
 {
 	if (!iterator_initialized)
 	{	
+		iterator_set = 0;
 		iterator_pos = 0;
 		iterator_initialized = true;	
 	}
 
-	int set = iterator_pos / nfeatures;
-	int pnt = iterator_pos % nfeatures;
 	int pos = counter + rPos + 1;
-	
-	if((set + 1) % sets == counter % sets)
-	{
-		set++;
-		iterator_pos += nfeatures;
-	}
-	
-	if(set >= sets || set >= counter)
+
+	// sets differ in size, iterator_pos runs through the points of iterator_set
+	while (iterator_set < sets && iterator_set < counter)
 	{
-		iterator_initialized = false;
-		return false;
+		const Points &from = points[iterator_set][(pos - 1 + sets) % sets];
+		const Points &to = points[iterator_set][pos % sets];
+
+		// the newest set has no movement yet
+		if ((iterator_set + 1) % sets != counter % sets && iterator_pos < static_cast<int>(std::min(from.size(), to.size())))
+		{
+			p1 = from[iterator_pos];
+			p2 = to[iterator_pos];
+			iterator_pnt = iterator_pos++;
+			return true;
+		}
+
+		iterator_set++;
+		iterator_pos = 0;
 	}
-	
-	p1 = points[set][(pos - 1 + sets) % sets][pnt];
-	p2 = points[set][pos % sets][pnt];
 
-	iterator_pos++;
-	
-	return true;
+	iterator_initialized = false;
+	return false;
 }
@@ -1,19 +1,23 @@
 #pragma once
 
+#include "LabelMap.h"
 #include "OFTracker.h"
 
 class OverlapOFTracker : public OFTracker
 {
 private:
-	Mask correctionMask;
-	int sets; // == future steps
-	std::vector<cv::Point2f> **points;
-	std::vector<char> *status;
-	std::vector<float> *error;
+	LabelMap labels; // box of the model that is scored
+	Points inside_from, inside_to; // votes of the scored model, for the refinement of its transform
+	Weights inside_weights;
+	int sets; // == future steps, counted in calls of next(), with a frame stride the sets span a variable time
+	std::vector<std::vector<Points> > points; // [set][step]
+	std::vector<Statuses> status;
+	std::vector<Errors> error;
 	int counter;
 	
 	bool iterator_initialized;
 	int iterator_pos;
+	int iterator_set, iterator_pnt; // set and point of the last pair
 
 public:
 	OverlapOFTracker();
@@ -25,12 +29,17 @@ public:
 
 protected:
 	virtual bool track()  override;
-	virtual bool iteratePoints(cv::Point2f &p1, cv::Point2f &p2) override;
+	virtual bool iteratePoints(cv::Point2f &p1, cv::Point2f &p2, float &error) override;
 	bool iteratePoints(int pos, cv::Point2f &p1, cv::Point2f &p2);
 
 private:
 	void deInit();
+	void allocate();
+	virtual void restart() override;
+	virtual void savePoints(TrackerState &state) const override;
+	virtual bool restorePoints(const TrackerState &state) override;
 	virtual void correct(FlowBox &bb) override;
+	void seed(int pos);
 	int scoreModel(FlowBox &bb);
 	std::vector<FlowBox> distributeModels(FlowBox &seed);
 };
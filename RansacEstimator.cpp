@@ -0,0 +1,143 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <algorithm>
+
+#include "RansacEstimator.h"
+
+#define INLIER_THRESHOLD 1.f // px
+#define MIN_BASELINE 2.f // px, shorter sample pairs don't determine the rotation
+#define CONFIDENCE 0.99
+#define MAX_ITERATIONS 500
+#define ROTATION_MARGIN 5 // degrees a hypothesis may leave the rotation window
+
+/*
+* exact rigid transform of two correspondences: the rotation turns the direction a1->a2 onto b1->b2
+*/
+static bool solveTwoPoint(const cv::Point2f &a1, const cv::Point2f &a2, const cv::Point2f &b1, const cv::Point2f &b2, cv::Point3f &T)
+{
+	cv::Point2f va = a2 - a1, vb = b2 - b1;
+
+	if (va.dot(va) < MIN_BASELINE * MIN_BASELINE) return false;
+
+	// A(phi) rotates by -phi
+	T.z = static_cast<float>((atan2(va.y, va.x) - atan2(vb.y, vb.x)) * 180 / M_PI);
+	T.z = static_cast<float>(fmod(T.z + 540, 360)) - 180;
+	T.x = 0;
+	T.y = 0;
+
+	cv::Point2f t = b1 - applyRigidTransform(T, a1);
+	T.x = t.x;
+	T.y = t.y;
+
+	return true;
+}
+
+RansacEstimator::RansacEstimator()
+:
+rotationCenter(0),
+rotationRange(180)
+{
+}
+
+RansacEstimator::~RansacEstimator()
+{
+}
+
+/*
+* Hypotheses turning further than the window (plus a margin) are rejected without scoring.
+*/
+void RansacEstimator::setRotationWindow(float center, int range)
+{
+	rotationCenter = cvRound(center);
+	rotationRange = range;
+}
+
+cv::Point3f RansacEstimator::estimate(const Points &from, const Points &to, const Weights &weights, int * score, cv::Point2f * scores)
+{
+	int n = static_cast<int>(from.size());
+	cv::Point3f best(0, 0, 0);
+	int best_count = 0;
+	int total = 0;
+
+	for (int i = 0; i < n; i++)
+		total += weights[i];
+
+	if (n >= 2)
+	{
+		std::uniform_int_distribution<int> pick(0, n - 1);
+		int iterations = MAX_ITERATIONS;
+
+		for (int it = 0; it < iterations; it++)
+		{
+			int i = pick(g), j = pick(g);
+			if (i == j) continue;
+
+			cv::Point3f T;
+			if (!solveTwoPoint(from[i], from[j], to[i], to[j], T)) continue;
+
+			float turn = static_cast<float>(fmod(T.z - rotationCenter + 540, 360)) - 180;
+			if (std::abs(turn) > rotationRange + ROTATION_MARGIN) continue;
+
+			int count = countInliers(T, from, to, weights, false);
+			if (count > best_count)
+			{
+				best_count = count;
+				best = T;
+
+				// adaptive number of iterations for a two-point sample
+				double w = static_cast<double>(count) / total;
+				double p_fail = 1 - w * w;
+				if (p_fail <= 0) iterations = 0;
+				else iterations = std::min(MAX_ITERATIONS, static_cast<int>(ceil(log(1 - CONFIDENCE) / log(p_fail))));
+			}
+		}
+
+		if (best_count > 0)
+		{
+			countInliers(best, from, to, weights, true);
+			if (inliers_from.size() >= 2)
+			{
+				best = fitRigidTransform(inliers_from, inliers_to, inlier_weights);
+				best_count = countInliers(best, from, to, weights, false);
+			}
+		}
+	}
+
+	if (score) (*score) = best_count;
+	if (scores) (*scores) = cv::Point2f(static_cast<float>(best_count), 0);
+
+	return best;
+}
+
+/*
+* summed weight of the correspondences T maps onto their counterpart
+*/
+int RansacEstimator::countInliers(const cv::Point3f &T, const Points &from, const Points &to, const Weights &weights, bool collect)
+{
+	int count = 0;
+
+	if (collect)
+	{
+		inliers_from.clear();
+		inliers_to.clear();
+		inlier_weights.clear();
+	}
+
+	for (int i = 0; i < static_cast<int>(from.size()); i++)
+	{
+		cv::Point2f d = applyRigidTransform(T, from[i]) - to[i];
+
+		if (d.dot(d) <= INLIER_THRESHOLD * INLIER_THRESHOLD)
+		{
+			count += weights[i];
+			if (collect)
+			{
+				inliers_from.push_back(from[i]);
+				inliers_to.push_back(to[i]);
+				inlier_weights.push_back(static_cast<float>(weights[i]));
+			}
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <random>
+
+#include "RigidEstimator.h"
+
+/*
+* RANSAC over the two-point closed-form rigid solver.
+* The number of iterations adapts to the inlier ratio found so far,
+* the best hypothesis is refitted to all of its inliers.
+*/
+class RansacEstimator : public RigidEstimator
+{
+	std::default_random_engine g;
+	int rotationCenter;
+	int rotationRange;
+	Points inliers_from, inliers_to;
+	std::vector<float> inlier_weights;
+
+public:
+	RansacEstimator();
+	~RansacEstimator();
+	virtual cv::Point3f estimate(const Points &from, const Points &to, const Weights &weights, int * score = 0, cv::Point2f * scores = 0) override;
+	virtual void setRotationWindow(float center, int range) override;
+
+private:
+	int countInliers(const cv::Point3f &T, const Points &from, const Points &to, const Weights &weights, bool collect);
+};
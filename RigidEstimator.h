@@ -0,0 +1,24 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "RigidTransform.h"
+
+#define ESTIMATOR_HOUGH 0
+#define ESTIMATOR_RANSAC 1
+#define ESTIMATOR_DECOUPLED 2 // HoughHash voting rotation and translation one after the other
+
+typedef std::vector<int> Weights; // vote of each correspondence
+
+/*
+* Interface of the estimators for the rigid transform that explains most correspondences from[i] -> to[i].
+* Every correspondence counts with its weight.
+* score is the support of the estimate, scores splits it into support and penalty.
+*/
+class RigidEstimator
+{
+public:
+	virtual ~RigidEstimator() {}
+	virtual cv::Point3f estimate(const Points &from, const Points &to, const Weights &weights, int * score = 0, cv::Point2f * scores = 0) = 0;
+	virtual void setRotationWindow(float center, int range) = 0;
+};
@@ -10,9 +10,13 @@
 #include <QFormLayout>
 
 #include <QFileDialog>
+#include <QMessageBox>
+#include <QTimer>
 #include <biotracker/TrackingAlgorithm.h>
 #include <biotracker/Registry.h>
 
+#include <thread>
+
 #define RS_NOT_SET 0
 #define RS_SET 1
 #define RS_INITIALIZE 2
@@ -26,6 +30,21 @@
 #define PAST_TRACK_COLOR 70, 240, 15
 #define FUTURE_TRACK_COLOR 35, 120, 8
 
+#define MAX_STRIDE 8 // frames an idle object is tracked across at once
+#define STRIDE_MAX_MOTION 0.5f // px or degrees per frame below which an object counts as idle
+#define STRIDE_MAX_DIFFERENCE 3.0 // mean absolute difference of the box to the anchor that ends a stride
+
+#define CHECKPOINT_CAPACITY (256 << 20) // bytes of tracker states kept to resume after scrubbing
+#define FRAME_STORE_CAPACITY (512 << 20) // bytes of gray frames kept to track them again, 250 frames of 1080p
+
+#define RETRACK_TOLERANCE 0.5f // px and degrees a re-tracked box may differ from the stored one to agree with it
+#define RETRACK_CONVERGED_FRAMES 3 // agreeing frames in a row that end re-tracking
+
+#define BLEND_FRAMES 4 // frames on each side of the middle between two keyframes where both passes are blended
+#define BLEND_MIN_SUPPORT 1e-3f // keeps the weights of passes without support positive
+
+#define TRACK_FILE_FILTER "Trajectories (*.rft);;JSON (*.json)" // anything but .json is saved in the binary format
+
 using namespace BioTracker::Core;
 
 extern "C" {
@@ -43,8 +62,16 @@ RigidFlowTracker::RigidFlowTracker(Settings &settings):
     m_tmpFlowBox(false),
     m_diff_path(false),
     m_futuresteps(10),
-    m_noncorrectionsteps(10),
+    m_noncorrectionsteps(0),
     m_correction_enabled(false),
+    m_refinement(false),
+    m_coarse_to_fine(false),
+    m_adaptive_features(false),
+    m_adaptive_stride(false),
+    m_stride(1),
+    m_anchor(0),
+    m_estimator(ESTIMATOR_HOUGH),
+    m_detector(DETECTOR_SHI_TOMASI),
     m_features(1000),
     m_automatictracking(true),
     m_updatefeatures(false),
@@ -53,13 +80,23 @@ RigidFlowTracker::RigidFlowTracker(Settings &settings):
     m_path_changed(false),
     m_ratio(2.5),
     m_rectstat(RS_NOT_SET),
-    m_of_tracker(new OverlapOFTracker()),
+    m_single_tracker(new SingleOFTracker()),
+    m_overlap_tracker(new OverlapOFTracker()),
+    m_of_tracker(m_overlap_tracker.get()),
+    m_checkpoints(CHECKPOINT_CAPACITY),
+    m_frames(FRAME_STORE_CAPACITY),
+    m_running_passes(0),
+    m_cancel_passes(false),
+    m_passes_object(0),
+    m_passes_run(0),
     m_cto(0),
     m_futurestepsEdit(new QLineEdit(getToolsWidget())),
     m_noncorrectionstepsEdit(new QLineEdit(getToolsWidget())),
     m_enable_correction(new QCheckBox(getToolsWidget())),
     m_featuresEdit(new QLineEdit(getToolsWidget())),
-    m_fixedratioEdit(new QCheckBox(getToolsWidget()))
+    m_fixedratioEdit(new QCheckBox(getToolsWidget())),
+    m_budgetEdit(new QLineEdit(getToolsWidget())),
+    m_qualityLabel(new QLabel(getToolsWidget()))
 {
     m_grabbedKeys.insert(Qt::Key_D);
     m_grabbedKeys.insert(Qt::Key_Delete);
@@ -72,16 +109,67 @@ RigidFlowTracker::RigidFlowTracker(Settings &settings):
 
     m_noncorrectionstepsEdit->setText(QString::number(m_noncorrectionsteps));
     m_noncorrectionstepsEdit->setDisabled(!m_correction_enabled);
-    layout->addRow("Non-Correction Steps", m_noncorrectionstepsEdit);
+    // 0 corrects only when the estimate looks weak
+    layout->addRow("Max. Non-Correction Steps", m_noncorrectionstepsEdit);
 
     m_enable_correction->setChecked(m_correction_enabled);
     QObject::connect(m_enable_correction, &QCheckBox::stateChanged,
                      this, &RigidFlowTracker::enableCorrection);
     layout->addRow("Enable Correction", m_enable_correction);
 
+    auto *refinement = new QCheckBox();
+    refinement->setChecked(m_refinement);
+    QObject::connect(refinement, &QCheckBox::stateChanged,
+                     this, &RigidFlowTracker::enableRefinement);
+    layout->addRow("Refine Transform", refinement);
+
+    auto *coarseToFine = new QCheckBox();
+    coarseToFine->setChecked(m_coarse_to_fine);
+    QObject::connect(coarseToFine, &QCheckBox::stateChanged,
+                     this, &RigidFlowTracker::enableCoarseToFine);
+    layout->addRow("Coarse to Fine", coarseToFine);
+
+    auto *adaptiveFeatures = new QCheckBox();
+    adaptiveFeatures->setChecked(m_adaptive_features);
+    QObject::connect(adaptiveFeatures, &QCheckBox::stateChanged,
+                     this, &RigidFlowTracker::enableAdaptiveFeatures);
+    layout->addRow("Adaptive Features", adaptiveFeatures);
+
+    auto *adaptiveStride = new QCheckBox();
+    adaptiveStride->setChecked(m_adaptive_stride);
+    QObject::connect(adaptiveStride, &QCheckBox::stateChanged,
+                     this, &RigidFlowTracker::enableAdaptiveStride);
+    layout->addRow("Adaptive Stride", adaptiveStride);
+
+    // item indices are the ESTIMATOR_* values
+    auto *estimator = new QComboBox();
+    estimator->addItem("Hough");
+    estimator->addItem("RANSAC");
+    estimator->addItem("Decoupled Hough");
+    estimator->setCurrentIndex(m_estimator);
+    QObject::connect(estimator, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+                     this, &RigidFlowTracker::changeEstimator);
+    layout->addRow("Estimator", estimator);
+
+    // item indices are the DETECTOR_* values
+    auto *detector = new QComboBox();
+    detector->addItem("Shi-Tomasi");
+    detector->addItem("FAST");
+    detector->setCurrentIndex(m_detector);
+    QObject::connect(detector, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+                     this, &RigidFlowTracker::changeDetector);
+    layout->addRow("Corner Detector", detector);
+
     m_featuresEdit->setText(QString::number(m_features));
     layout->addRow("Number of Features", m_featuresEdit);
 
+    // 0 disables the real-time mode
+    m_budgetEdit->setText(QString::number(0));
+    layout->addRow("Frame Budget (ms)", m_budgetEdit);
+
+    updateQualityLabel();
+    layout->addRow("Real-time Quality", m_qualityLabel);
+
     auto *paramBut = new QPushButton("Change Parameters");
     QObject::connect(paramBut, &QPushButton::clicked,
                      this, &RigidFlowTracker::changeParams);
@@ -115,35 +203,67 @@ RigidFlowTracker::RigidFlowTracker(Settings &settings):
                      this, &RigidFlowTracker::deletePath);
     layout->addRow(deletePathBut);
 
+    auto *retrackBut = new QPushButton("Re-track Forward");
+    QObject::connect(retrackBut, &QPushButton::clicked,
+                     this, &RigidFlowTracker::retrackForward);
+    layout->addRow(retrackBut);
+
+    auto *bothWaysBut = new QPushButton("Track Both Directions");
+    QObject::connect(bothWaysBut, &QPushButton::clicked,
+                     this, &RigidFlowTracker::trackBothWays);
+    layout->addRow(bothWaysBut);
+
+    auto *saveTracksBut = new QPushButton("Save Trajectories");
+    QObject::connect(saveTracksBut, &QPushButton::clicked,
+                     this, &RigidFlowTracker::saveTracks);
+    layout->addRow(saveTracksBut);
+
+    auto *loadTracksBut = new QPushButton("Load Trajectories");
+    QObject::connect(loadTracksBut, &QPushButton::clicked,
+                     this, &RigidFlowTracker::loadTracks);
+    layout->addRow(loadTracksBut);
+
+    auto *convertTracksBut = new QPushButton("Convert Trajectories");
+    QObject::connect(convertTracksBut, &QPushButton::clicked,
+                     this, &RigidFlowTracker::convertTracks);
+    layout->addRow(convertTracksBut);
+
     ui->setLayout(layout);
 }
 
+RigidFlowTracker::~RigidFlowTracker() {
+    cancelBothWays();
+}
+
 void RigidFlowTracker::track(size_t frame, const cv::Mat &imgOriginal) {
+    m_scheduler.begin();
     cv::Mat imgCopy = imgOriginal.clone();
     // can't track without an image
     if(imgCopy.empty()) return;
+    // every frame, also those without a box, paths may be tracked over them later
+    m_frames.add(frame, imgCopy);
     // doesn't need to retrack the same frame
     // happens when video is played
     if(m_currentFrame - frame == 0) return;
 
     // currently tracked Object doesn't exist in the trackedObjects vector
     // usually happens when track is called before any box was created
-    if(m_cto >= static_cast<int>(m_trackedObjects.size())) return;
+    if(m_cto >= static_cast<int>(m_tracks.size())) return;
 
     if (m_tmpFlowBox) {
         m_tmpFlowBox = false;
-        m_trackedObjects[m_cto].erase(m_currentFrame);
+        m_tracks[m_cto].erase(m_currentFrame);
     }
 
     // reset Tracker if user skipped through the video or went backwards with automatic tracking enabled
     int prevFrame = -1;
     if(abs(static_cast<int>(m_currentFrame) - static_cast<int>(frame)) != 1 ||
        (m_automatictracking && static_cast<int>(m_currentFrame) - static_cast<int>(frame) != -1)) {
-        if (!m_automatictracking) {
-            reinterpret_cast<SingleOFTracker*>(m_of_tracker)->reset();
-        } else {
-            reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->reset();
+        // continue from a neighbouring frame the tracker passed before, otherwise start over
+        if (!resume(frame, imgCopy, prevFrame)) {
+            m_of_tracker->reset();
         }
+        m_stride = 1;
     } else {
         prevFrame = static_cast<int>(m_currentFrame) - static_cast<int>(frame);
     }
@@ -151,30 +271,49 @@ void RigidFlowTracker::track(size_t frame, const cv::Mat &imgOriginal) {
     m_currentFrame = frame;
 
     // can't track without a box either in this or the previous frame
-    if(!m_trackedObjects[m_cto].hasValuesAtFrame(frame) && !m_trackedObjects[m_cto].hasValuesAtFrame(frame + prevFrame)){
+    if(!m_tracks[m_cto].has(frame) && !m_tracks[m_cto].has(frame + prevFrame)){
         return;
     }
 
     // initialize tracker if it's not initialized
     if (!m_of_tracker->isInitialized()) {
-        //semi-automatic or automatic tracking
-        if (!m_automatictracking) {
-            reinterpret_cast<SingleOFTracker*>(m_of_tracker)->configure(m_features);
-            reinterpret_cast<SingleOFTracker*>(m_of_tracker)->init(m_currentImage, *m_trackedObjects[m_cto].get<FlowBox>(m_currentFrame));
-        } else {
-            reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->configure(m_futuresteps, m_noncorrectionsteps, m_features, m_correction_enabled);
-            reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->init(m_currentImage, *m_trackedObjects[m_cto].get<FlowBox>(m_currentFrame));
-        }
+        applySettings();
+        // the tracker starts from the previous frame
+        m_anchor = frame - 1;
+        m_anchorImage = m_currentImage;
+        m_stride = 1;
+        FlowBox box = m_tracks[m_cto].get(m_currentFrame);
+        m_of_tracker->init(m_currentImage, box);
     }
     if(!m_automatictracking || prevFrame < 0 || m_path_changed) {
         //copy FlowBox from previous frame
-        if (!m_trackedObjects[m_cto].hasValuesAtFrame(frame) || (m_trackedObjects[m_cto].hasValuesAtFrame(frame + prevFrame) && !m_path_changed)) {
-            auto o = std::make_shared<FlowBox>(m_trackedObjects[m_cto].get<FlowBox>(frame + prevFrame));
-            m_trackedObjects[m_cto].add(frame, o);
+        if (!m_tracks[m_cto].has(frame) || (m_tracks[m_cto].has(frame + prevFrame) && !m_path_changed)) {
+            m_tracks[m_cto].set(frame, m_tracks[m_cto].get(frame + prevFrame));
         }
+        bool forward = prevFrame == -1 && !m_path_changed;
         m_path_changed = false;
-        //calculate movement for next step
-        m_of_tracker->next(imgCopy, *m_trackedObjects[m_cto].get<FlowBox>(frame));
+        // idle objects keep their pose until the stride is over or they move
+        if (!forward || !holdPose(frame, imgCopy)) {
+            //calculate movement for next step
+            m_feature_map.setFrame(imgCopy);
+            FlowBox box = m_tracks[m_cto].get(frame);
+            // a stride that ends moves the box across all frames since the anchor at once
+            int span = (forward && frame > m_anchor) ? static_cast<int>(std::min<size_t>(frame - m_anchor, MAX_STRIDE)) : 1;
+            m_of_tracker->next(imgCopy, box, span);
+            m_tracks[m_cto].set(frame, box);
+            m_checkpoints.save(m_cto, frame, box, *m_of_tracker);
+
+            if (forward) {
+                adaptStride(frame, imgCopy);
+            } else {
+                m_stride = 1;
+            }
+        }
+
+        // the quality for the next frame
+        m_scheduler.end();
+        m_of_tracker->setQuality(m_scheduler.getQuality());
+        updateQualityLabel();
     }
     m_currentImage = imgCopy;
 }
@@ -186,7 +325,7 @@ void RigidFlowTracker::paint(size_t , ProxyMat & mat, const TrackingAlgorithm::V
 void RigidFlowTracker::paintOverlay(size_t frame, QPainter *painter, const View &) {
     if (frame != m_currentFrame && m_tmpFlowBox) {
         m_tmpFlowBox = false;
-        m_trackedObjects[m_cto].erase(m_currentFrame);
+        m_tracks[m_cto].erase(m_currentFrame);
     }
 
     m_currentFrame = frame;
@@ -203,12 +342,42 @@ void RigidFlowTracker::paintOverlay(size_t frame, QPainter *painter, const View
 
 void RigidFlowTracker::prepareSave() {
     if(m_tmpFlowBox) {
-        m_trackedObjects[m_cto].erase(m_currentFrame);
+        m_tracks[m_cto].erase(m_currentFrame);
+    }
+
+    // the core serializes TrackedObjects
+    m_trackedObjects.clear();
+    for (size_t i = 0; i < m_tracks.size(); i++) {
+        TrackedObject o(i);
+        m_tracks[i].toTrackedObject(o);
+        m_trackedObjects.push_back(o);
     }
+
+    // the core saves right after this call, the boxes are dropped again once control is back in the event loop
+    QTimer::singleShot(0, this, &RigidFlowTracker::releaseTrackedObjects);
+}
+
+/*
+* drops the TrackedObjects built for saving, the boxes live in the track stores only
+*/
+void RigidFlowTracker::releaseTrackedObjects() {
+    m_trackedObjects.clear();
+    m_trackedObjects.shrink_to_fit();
 }
 
 void RigidFlowTracker::postLoad() {
-    if(m_trackedObjects.size() > 0){
+    cancelBothWays();
+    m_keyframes.clear();
+
+    // keeps the boxes in the track stores only
+    m_tracks.clear();
+    m_tracks.resize(m_trackedObjects.size());
+    for (size_t i = 0; i < m_trackedObjects.size(); i++) {
+        m_tracks[i].fromTrackedObject(m_trackedObjects[i]);
+    }
+    releaseTrackedObjects();
+
+    if(m_tracks.size() > 0){
         m_cto = 0;
         m_rectstat = RS_INITIALIZE;
     }
@@ -226,10 +395,10 @@ void RigidFlowTracker::keyPressEvent(QKeyEvent *ev) {
     } 
 	else if (ev->key() == Qt::Key_Delete) 
 	{
-        if ( m_trackedObjects[m_cto].hasValuesAtFrame(m_currentFrame) && !m_tmpFlowBox) 
+        if ( m_tracks[m_cto].has(m_currentFrame) && !m_tmpFlowBox) 
 		{
-            m_trackedObjects[m_cto].erase(m_currentFrame);
-            if(m_trackedObjects[m_cto].isEmpty()){
+            m_tracks[m_cto].erase(m_currentFrame);
+            if(m_tracks[m_cto].isEmpty()){
                 deletePath();
             }
             Q_EMIT jumpToFrame(static_cast<int>(m_currentFrame) + 1); // doesn't work, core problem?
@@ -248,17 +417,15 @@ void RigidFlowTracker::mousePressEvent(QMouseEvent * e) {
     if (e->button() == Qt::LeftButton) {
         // add new FlowBox
         if (e->modifiers() == Qt::ControlModifier) {
-            m_cto = static_cast<int>(m_trackedObjects.size());
-
-            auto bb = std::make_shared<FlowBox>();
-            TrackedObject o(m_cto);
-            o.add(m_currentFrame, bb);
-            m_trackedObjects.push_back(o);
-
-            bb->x = e->x();
-            bb->y = e->y();
+            m_cto = static_cast<int>(m_tracks.size());
+
+            FlowBox bb;
+            bb.x = e->x();
+            bb.y = e->y();
+            bb.phi = 0;
+            m_tracks.emplace_back();
+            m_tracks.back().set(m_currentFrame, bb);
             m_rectstat = RS_INITIALIZE;
-            bb->phi = 0;
         }
 
         if (m_rectstat == RS_SET) {
@@ -266,33 +433,33 @@ void RigidFlowTracker::mousePressEvent(QMouseEvent * e) {
 
             //check if mouse click happened inside any rectangle
             bool in = false;
-            for (auto o : m_trackedObjects) {
-                if (o.hasValuesAtFrame(m_currentFrame)) {
-                    if (clickInsideRectangle(o.get<FlowBox>(m_currentFrame)->getCornerPoints(), e)) {
+            for (int id = 0; id < static_cast<int>(m_tracks.size()); id++) {
+                TrackStore &o = m_tracks[id];
+                if (o.has(m_currentFrame)) {
+                    if (clickInsideRectangle(o.get(m_currentFrame).getCornerPoints(), e)) {
                         in = true;
                         // if a temporary Box was on the frame, delete it
-                        if(m_tmpFlowBox && static_cast<int>(o.getId()) != m_cto) {
+                        if(m_tmpFlowBox && id != m_cto) {
                             m_tmpFlowBox = false;
-                            m_trackedObjects[m_cto].erase(m_currentFrame);
+                            m_tracks[m_cto].erase(m_currentFrame);
                             m_diff_path = true;
                         }
-                        m_cto = static_cast<int>(o.getId());
+                        m_cto = id;
                         break;
                     }
                 } else {
-                    if (clickInsideRectangle(o.get<FlowBox>(o.getLastFrameNumber().get())->getCornerPoints(), e)){
+                    if (clickInsideRectangle(o.get(o.lastFrame()).getCornerPoints(), e)){
                         // if a temporary Box was on the frame, delete it
                         if(m_tmpFlowBox) {
-                            m_trackedObjects[m_cto].erase(m_currentFrame);
+                            m_tracks[m_cto].erase(m_currentFrame);
                         } else {
                             m_tmpFlowBox = true;
                         }
                         m_diff_path = true;
                         // add new temporary Box, which is a copy from the last tracked frame of the selected tracked Object
                         in = true;
-                        m_cto = static_cast<int>(o.getId());
-                        o.add(m_currentFrame, std::make_shared<FlowBox>(o.get<FlowBox>(o.getLastFrameNumber().get())));
-                        m_trackedObjects[m_cto].add(m_currentFrame, std::make_shared<FlowBox>(o.get<FlowBox>(o.getLastFrameNumber().get())));
+                        m_cto = id;
+                        o.set(m_currentFrame, o.get(o.lastFrame()));
                         break;
                     }
                 }
@@ -315,7 +482,7 @@ void RigidFlowTracker::mousePressEvent(QMouseEvent * e) {
     }
     // rotate mode
     else if (e->button() == Qt::RightButton) {
-        if(m_cto >= static_cast<int>(m_trackedObjects.size()) || !m_trackedObjects[m_cto].hasValuesAtFrame(m_currentFrame)) return;
+        if(m_cto >= static_cast<int>(m_tracks.size()) || !m_tracks[m_cto].has(m_currentFrame)) return;
 
         updatePoints(static_cast<int>(m_currentFrame));
 
@@ -332,43 +499,44 @@ void RigidFlowTracker::mouseMoveEvent(QMouseEvent * e) {
     //forbidding any mouse interaction while the video is playing
 //    if (getVideoMode() != GuiParam::VideoMode::Paused) return;
 
-    if(m_cto >= static_cast<int>(m_trackedObjects.size()) || !m_trackedObjects[m_cto].hasValuesAtFrame(m_currentFrame)) return;
+    if(m_cto >= static_cast<int>(m_tracks.size()) || !m_tracks[m_cto].has(m_currentFrame)) return;
 
-    std::shared_ptr<FlowBox> currentFlowBox = m_trackedObjects[m_cto].get<FlowBox>(m_currentFrame);
+    FlowBox currentFlowBox = m_tracks[m_cto].get(m_currentFrame);
 
     //what we do when we are scaling the bounding box
     if (m_rectstat == RS_INITIALIZE || m_rectstat == RS_SCALE) {
-        float p = static_cast<float>(currentFlowBox->phi * 3.1415 / 180);
-        float h = e->x() - currentFlowBox->x;
-        float w = e->y() - currentFlowBox->y;
-        int x = static_cast<int>(currentFlowBox->x + sin(-p) * h - cos(-p) * w);
-        int y = static_cast<int>(currentFlowBox->y + cos(-p) * h + sin(-p) * w);
-        currentFlowBox->h = 2 * abs(x - static_cast<int>(currentFlowBox->x));
-
-        if (m_fixedratio) currentFlowBox->w = currentFlowBox->h / m_ratio;
-        else currentFlowBox->w = 2 * abs(y - static_cast<int>(currentFlowBox->y));
+        float p = static_cast<float>(currentFlowBox.phi * 3.1415 / 180);
+        float h = e->x() - currentFlowBox.x;
+        float w = e->y() - currentFlowBox.y;
+        int x = static_cast<int>(currentFlowBox.x + sin(-p) * h - cos(-p) * w);
+        int y = static_cast<int>(currentFlowBox.y + cos(-p) * h + sin(-p) * w);
+        currentFlowBox.h = 2 * abs(x - static_cast<int>(currentFlowBox.x));
+
+        if (m_fixedratio) currentFlowBox.w = currentFlowBox.h / m_ratio;
+        else currentFlowBox.w = 2 * abs(y - static_cast<int>(currentFlowBox.y));
         m_path_changed = true;
 
         Q_EMIT update();
     }
     //what we do when we are dragging the bounding box
     else if (m_rectstat == RS_DRAG) {
-        currentFlowBox->x += e->x() - m_mdx;
-        currentFlowBox->y += e->y() - m_mdy;
+        currentFlowBox.x += e->x() - m_mdx;
+        currentFlowBox.y += e->y() - m_mdy;
         m_mdx = e->x();
         m_mdy = e->y();
         m_path_changed = true;
     }
     //what we do when we are rotating the bounding box
     else if (m_rectstat == RS_ROTATE) {
-        auto tmpLR = cv::Point2i(static_cast<int>(m_last_rotation_point.x - currentFlowBox->x),
-                            static_cast<int>(m_last_rotation_point.y - currentFlowBox->y));
-        auto tmpE = cv::Point2i(static_cast<int>(e->x() - currentFlowBox->x), static_cast<int>(e->y() - currentFlowBox->y));
+        auto tmpLR = cv::Point2i(static_cast<int>(m_last_rotation_point.x - currentFlowBox.x),
+                            static_cast<int>(m_last_rotation_point.y - currentFlowBox.y));
+        auto tmpE = cv::Point2i(static_cast<int>(e->x() - currentFlowBox.x), static_cast<int>(e->y() - currentFlowBox.y));
         float phiTemp = static_cast<float>(atan2(tmpLR.y, tmpLR.x) * 180 / CV_PI) - static_cast<float>(atan2(tmpE.y, tmpE.x) * 180 / CV_PI);
-        currentFlowBox->phi = static_cast<float>(fmod(currentFlowBox->phi + phiTemp, 360));
+        currentFlowBox.phi = static_cast<float>(fmod(currentFlowBox.phi + phiTemp, 360));
         m_last_rotation_point = cv::Point2i(static_cast<int>(e->x()), static_cast<int>(e->y()));
         m_path_changed = true;
     }
+    m_tracks[m_cto].set(m_currentFrame, currentFlowBox);
     Q_EMIT update();
 }
 
@@ -382,15 +550,12 @@ void RigidFlowTracker::mouseReleaseEvent(QMouseEvent * e) {
             (e->button() == Qt::RightButton && m_rectstat == RS_ROTATE)) {
         m_rectstat = RS_SET;
 
-        if (!m_automatictracking) {
-            reinterpret_cast<SingleOFTracker*>(m_of_tracker)->reset();
-            reinterpret_cast<SingleOFTracker*>(m_of_tracker)->configure(m_features);
-            reinterpret_cast<SingleOFTracker*>(m_of_tracker)->init(m_currentImage, *m_trackedObjects[m_cto].get<FlowBox>(m_currentFrame));
-        } else {
-            reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->reset();
-            reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->configure(m_futuresteps, m_noncorrectionsteps, m_features, m_correction_enabled);
-            reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->init(m_currentImage, *m_trackedObjects[m_cto].get<FlowBox>(m_currentFrame));
-        }
+        // keeps the buffers of the tracker, only the points start over at the edited box
+        configureTracker();
+        FlowBox box = m_tracks[m_cto].get(m_currentFrame);
+        m_of_tracker->retarget(m_currentImage, box);
+        m_checkpoints.save(m_cto, m_currentFrame, box, *m_of_tracker);
+        keyframesOf(m_cto).insert(m_currentFrame);
 
         if(m_diff_path){
             m_diff_path = false;
@@ -425,13 +590,13 @@ bool RigidFlowTracker::clickInsideRectangle(std::vector<cv::Point2i> pts, QMouse
 * draws every path currently in the paths vector
 */
 void RigidFlowTracker::drawPath(QPainter *painter){
-    if (m_cto >= static_cast<int>(m_trackedObjects.size()) || !m_trackedObjects[m_cto].hasValuesAtFrame(m_currentFrame)) return;
+    if (m_cto >= static_cast<int>(m_tracks.size()) || !m_tracks[m_cto].has(m_currentFrame)) return;
 
-    auto o = m_trackedObjects[m_cto];
-    for (size_t frame = 1; frame < o.getLastFrameNumber().get() + 1; frame++) {
-        if (o.hasValuesAtFrame(frame) && o.hasValuesAtFrame(frame-1)) {
-            FlowBox point1 = o.get<FlowBox>(frame - 1);
-            FlowBox point2 = o.get<FlowBox>(frame);
+    const TrackStore &o = m_tracks[m_cto];
+    for (size_t frame = 1; frame < o.lastFrame() + 1; frame++) {
+        if (o.has(frame) && o.has(frame-1)) {
+            FlowBox point1 = o.get(frame - 1);
+            FlowBox point2 = o.get(frame);
 
             QPoint p1 = QPoint(static_cast<int>(point1.x), static_cast<int>(point1.y));
             QPoint p2 = QPoint(static_cast<int>(point2.x), static_cast<int>(point2.y));
@@ -455,22 +620,22 @@ void RigidFlowTracker::drawPath(QPainter *painter){
  *      temporary Box will be created and drawn
  */
 void RigidFlowTracker::drawRectangle(QPainter *painter, size_t frame) {
-    for (auto o : m_trackedObjects) {
+    for (int id = 0; id < static_cast<int>(m_tracks.size()); id++) {
+        TrackStore &o = m_tracks[id];
 		size_t tmpFrame;
         QColor c;
-        if (o.hasValuesAtFrame(static_cast<int>(frame))) {
+        if (o.has(frame)) {
             tmpFrame = frame;
-			c = static_cast<int>(o.getId()) == m_cto ? (m_tmpFlowBox ? QColor(BOX_COLOR_FAKE) : QColor(BOX_COLOR)) : QColor(BOX_COLOR_INACTIVE);
-		} else if (static_cast<int>(o.getId()) == m_cto && static_cast<int>(frame) > 0 && o.hasValuesAtFrame(frame - 1)) {
+			c = id == m_cto ? (m_tmpFlowBox ? QColor(BOX_COLOR_FAKE) : QColor(BOX_COLOR)) : QColor(BOX_COLOR_INACTIVE);
+		} else if (id == m_cto && static_cast<int>(frame) > 0 && o.has(frame - 1)) {
             tmpFrame = frame;
             m_tmpFlowBox = true;
-            m_trackedObjects[m_cto].add(frame, std::make_shared<FlowBox>(m_trackedObjects[m_cto].get<FlowBox>(frame - 1)));
-            o.add(frame, std::make_shared<FlowBox>(m_trackedObjects[m_cto].get<FlowBox>(frame - 1)));
+            o.set(frame, o.get(frame - 1));
             c = QColor(BOX_COLOR_FAKE);
         } else {
-            if(o.getLastFrameNumber()) {
-                tmpFrame = o.getLastFrameNumber().get();
-				c = static_cast<int>(o.getId()) == m_cto ? QColor(BOX_COLOR, 60) : QColor(BOX_COLOR_INACTIVE, 60);
+            if(!o.isEmpty()) {
+                tmpFrame = o.lastFrame();
+				c = id == m_cto ? QColor(BOX_COLOR, 60) : QColor(BOX_COLOR_INACTIVE, 60);
             } else {
                 break;
             }
@@ -479,25 +644,25 @@ void RigidFlowTracker::drawRectangle(QPainter *painter, size_t frame) {
         pen.setWidthF(1.5);
         painter->setPen(pen);
 
-        std::shared_ptr<FlowBox> currentFlowBox = o.get<FlowBox>(tmpFrame);
+        FlowBox currentFlowBox = o.get(tmpFrame);
 
-        std::vector<cv::Point2i> box = currentFlowBox->getCornerPoints();
+        std::vector<cv::Point2i> box = currentFlowBox.getCornerPoints();
 
         //draw the bounding box
         for (int i = 0; i < 4; i++) {
             painter->drawLine(box[i].x, box[i].y, box[(i + 1) % 4].x, box[(i + 1) % 4].y);
         }
 
-        std::vector<QPointF> arrow = getArrowPoints(tmpFrame, o.getId());
+        std::vector<QPointF> arrow = getArrowPoints(tmpFrame, id);
         // direction indicator
         painter->drawLine(arrow[0], arrow[1]);
         painter->drawLine(arrow[0], arrow[2]);
         painter->drawLine(arrow[0], arrow[3]);
 
         // draw id
-        QPointF textCenter = QPointF(currentFlowBox->x + sin(currentFlowBox->phi* CV_PI / 180) * currentFlowBox->h * -0.4,
-                                     currentFlowBox->y + cos(currentFlowBox->phi* CV_PI / 180) * currentFlowBox->h * -0.4);
-        int textheight = currentFlowBox->h*0.15>16.0?16:static_cast<int>(currentFlowBox->h * 0.15);
+        QPointF textCenter = QPointF(currentFlowBox.x + sin(currentFlowBox.phi* CV_PI / 180) * currentFlowBox.h * -0.4,
+                                     currentFlowBox.y + cos(currentFlowBox.phi* CV_PI / 180) * currentFlowBox.h * -0.4);
+        int textheight = currentFlowBox.h*0.15>16.0?16:static_cast<int>(currentFlowBox.h * 0.15);
         textheight = textheight>0?textheight:1;
 
         QFont font = painter->font();
@@ -505,17 +670,17 @@ void RigidFlowTracker::drawRectangle(QPainter *painter, size_t frame) {
         painter->setFont(font);
 
         painter->translate(textCenter);
-        painter->rotate(-currentFlowBox->phi + 180);
+        painter->rotate(-currentFlowBox.phi + 180);
 
-        painter->drawText(QRectF(-currentFlowBox->w/2,-currentFlowBox->h*0.15/2,currentFlowBox->w,currentFlowBox->h*0.15),
-                          Qt::AlignCenter, std::to_string(o.getId()).c_str());
+        painter->drawText(QRectF(-currentFlowBox.w/2,-currentFlowBox.h*0.15/2,currentFlowBox.w,currentFlowBox.h*0.15),
+                          Qt::AlignCenter, std::to_string(id).c_str());
 
-        painter->rotate(currentFlowBox->phi + 180);
+        painter->rotate(currentFlowBox.phi + 180);
         painter->translate(-textCenter);
 
         // draw resize points on active box
-        if (static_cast<int>(o.getId()) == m_cto &&
-            (tmpFrame == frame || (static_cast<int>(frame) - 1 > -1 && o.hasValuesAtFrame(static_cast<int>(frame) - 1)))) {
+        if (id == m_cto &&
+            (tmpFrame == frame || (static_cast<int>(frame) - 1 > -1 && o.has(frame - 1)))) {
             //make sure the corner points are up to date
             updatePoints(tmpFrame);
 
@@ -541,36 +706,36 @@ void RigidFlowTracker::drawRectangle(QPainter *painter, size_t frame) {
 * update the corner points by calculating their current positions based on the centre, width, height and rotation of the mask
 */
 void RigidFlowTracker::updatePoints(size_t frame) {
-    if(!m_trackedObjects[m_cto].hasValuesAtFrame(frame)) {
+    if(!m_tracks[m_cto].has(frame)) {
         // this happens after the video gets paused and getCurrentFrameNumber()
         //      returns currently painted frame + 1
         return;
     }
-    auto currentFlowBox = m_trackedObjects[m_cto].get<FlowBox>(frame);
+    FlowBox currentFlowBox = m_tracks[m_cto].get(frame);
 
-    m_pts = currentFlowBox->getCornerPoints();
+    m_pts = currentFlowBox.getCornerPoints();
 }
 
 /*
  * calculates the points needed to draw the arrow inside the box
  */
 std::vector<QPointF> RigidFlowTracker::getArrowPoints(size_t frame, size_t cto) {
-    if(!m_trackedObjects[cto].hasValuesAtFrame(frame)) {
+    if(!m_tracks[cto].has(frame)) {
         return std::vector<QPointF>(4);
     }
-    auto currentFlowBox = m_trackedObjects[cto].get<FlowBox>(frame);
+    FlowBox currentFlowBox = m_tracks[cto].get(frame);
 
-    double h = currentFlowBox->h / 2;
-    double w = currentFlowBox->w / 2;
-    double p = currentFlowBox->phi * CV_PI / 180;
+    double h = currentFlowBox.h / 2;
+    double w = currentFlowBox.w / 2;
+    double p = currentFlowBox.phi * CV_PI / 180;
 
     std::vector<QPointF> arrow(4);
-    arrow[0] = QPointF(currentFlowBox->x + sin(p) * h * 0.6, currentFlowBox->y + cos(p) * h * 0.6);
-    arrow[1] = QPointF(currentFlowBox->x + sin(p) * h * -0.6, currentFlowBox->y + cos(p) * h * -0.6);
-    arrow[2] = QPointF(currentFlowBox->x + sin(p) * h * 0.6 + sin(p - (135*CV_PI /180)) * w * 0.6,
-                       currentFlowBox->y + cos(p) * h * 0.6 + cos(p - (135*CV_PI /180)) * w * 0.6);
-    arrow[3] = QPointF(currentFlowBox->x + sin(p) * h * 0.6 + sin(p + (135*CV_PI /180)) * w * 0.6,
-                       currentFlowBox->y + cos(p) * h * 0.6 + cos(p + (135*CV_PI /180)) * w * 0.6);
+    arrow[0] = QPointF(currentFlowBox.x + sin(p) * h * 0.6, currentFlowBox.y + cos(p) * h * 0.6);
+    arrow[1] = QPointF(currentFlowBox.x + sin(p) * h * -0.6, currentFlowBox.y + cos(p) * h * -0.6);
+    arrow[2] = QPointF(currentFlowBox.x + sin(p) * h * 0.6 + sin(p - (135*CV_PI /180)) * w * 0.6,
+                       currentFlowBox.y + cos(p) * h * 0.6 + cos(p - (135*CV_PI /180)) * w * 0.6);
+    arrow[3] = QPointF(currentFlowBox.x + sin(p) * h * 0.6 + sin(p + (135*CV_PI /180)) * w * 0.6,
+                       currentFlowBox.y + cos(p) * h * 0.6 + cos(p + (135*CV_PI /180)) * w * 0.6);
     return arrow;
 }
 
@@ -585,10 +750,10 @@ std::vector<QPointF> RigidFlowTracker::getArrowPoints(size_t frame, size_t cto)
 * enables/disables fixed ratio of the bounding box
 */
 void RigidFlowTracker::fixRatio() {
-    if(m_trackedObjects[m_cto].hasValuesAtFrame(m_currentFrame)) {
-        auto currentFlowBox = m_trackedObjects[m_cto].get<FlowBox>(m_currentFrame);
-        if (!m_fixedratio && currentFlowBox->w != 0) {
-            m_ratio = currentFlowBox->h / currentFlowBox->w;
+    if(m_tracks[m_cto].has(m_currentFrame)) {
+        FlowBox currentFlowBox = m_tracks[m_cto].get(m_currentFrame);
+        if (!m_fixedratio && currentFlowBox.w != 0) {
+            m_ratio = currentFlowBox.h / currentFlowBox.w;
         }
     }
     m_fixedratio = !m_fixedratio;
@@ -613,6 +778,143 @@ void RigidFlowTracker::enableCorrection() {
     Q_EMIT update();
 }
 
+/*
+* enables/disables the least squares refinement of the estimated transform
+*/
+void RigidFlowTracker::enableRefinement() {
+    m_refinement = !m_refinement;
+    m_of_tracker->setRefinement(m_refinement);
+    Q_EMIT update();
+}
+
+/*
+* enables/disables tracking on half the resolution, the tracker restarts with the next frame
+*/
+void RigidFlowTracker::enableCoarseToFine() {
+    m_coarse_to_fine = !m_coarse_to_fine;
+    m_of_tracker->reset();
+    m_of_tracker->setCoarseToFine(m_coarse_to_fine);
+    m_checkpoints.clear();
+    Q_EMIT update();
+}
+
+/*
+* shows the quality level of the real-time mode, the missed deadlines and the cost of the tracking stages
+*/
+void RigidFlowTracker::updateQualityLabel() {
+    if (!m_scheduler.isEnabled()) {
+        m_qualityLabel->setText("off");
+        return;
+    }
+
+    const StageCosts &costs = m_of_tracker->getStageCosts();
+    m_qualityLabel->setText(QString("level %1, %2 missed\n%3 ms: track %4, estimate %5, correct %6")
+        .arg(m_scheduler.getQuality())
+        .arg(m_scheduler.getMissed())
+        .arg(m_scheduler.getLastCost(), 0, 'f', 1)
+        .arg(costs.track, 0, 'f', 1)
+        .arg(costs.estimate, 0, 'f', 1)
+        .arg(costs.correct, 0, 'f', 1));
+}
+
+/*
+* checks if frame can keep the pose of the previous one because the object is idle.
+* The stride ends early as soon as the box differs from the anchor, the frame the stride started at.
+*/
+bool RigidFlowTracker::holdPose(size_t frame, const cv::Mat &image) {
+    if (!m_adaptive_stride || m_stride <= 1 || frame <= m_anchor || frame - m_anchor >= static_cast<size_t>(m_stride)) {
+        return false;
+    }
+
+    if (m_anchorImage.size() != image.size() || m_anchorImage.type() != image.type()) {
+        return false;
+    }
+
+    std::vector<cv::Point> corners = m_tracks[m_cto].get(frame).getCornerPoints();
+    cv::Rect roi = cv::boundingRect(corners) & cv::Rect(0, 0, image.cols, image.rows);
+    if (roi.area() == 0) {
+        return false;
+    }
+
+    double difference = cv::norm(image(roi), m_anchorImage(roi), cv::NORM_L1) / (roi.area() * image.channels());
+    if (difference > STRIDE_MAX_DIFFERENCE) {
+        m_stride = 1;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+* interpolates the poses held since the anchor, then grows the stride while the object stays idle
+* and drops it to 1 as soon as it moves
+*/
+void RigidFlowTracker::adaptStride(size_t frame, const cv::Mat &image) {
+    auto &object = m_tracks[m_cto];
+    size_t span = frame - m_anchor;
+
+    if (frame > m_anchor && object.has(m_anchor)) {
+        FlowBox from = object.get(m_anchor);
+        FlowBox to = object.get(frame);
+        float dphi = static_cast<float>(fmod(to.phi - from.phi + 540, 360) - 180);
+
+        for (size_t f = m_anchor + 1; f < frame; f++) {
+            if (!object.has(f)) continue;
+
+            float t = static_cast<float>(f - m_anchor) / span;
+            FlowBox box = object.get(f);
+            box.x = from.x + t * (to.x - from.x);
+            box.y = from.y + t * (to.y - from.y);
+            box.phi = static_cast<float>(fmod(from.phi + t * dphi + 360, 360));
+            object.set(f, box);
+        }
+
+        float motion = std::max(std::max(std::abs(to.x - from.x), std::abs(to.y - from.y)), std::abs(dphi)) / span;
+        m_stride = (m_adaptive_stride && motion < STRIDE_MAX_MOTION) ? std::min(m_stride + 1, MAX_STRIDE) : 1;
+    } else {
+        m_stride = 1;
+    }
+
+    m_anchor = frame;
+    m_anchorImage = image;
+}
+
+/*
+* enables/disables tracking idle objects across several frames at once
+*/
+void RigidFlowTracker::enableAdaptiveStride() {
+    m_adaptive_stride = !m_adaptive_stride;
+    m_stride = 1;
+    Q_EMIT update();
+}
+
+/*
+* enables/disables the automatic number of features, "Number of Features" becomes the upper bound
+*/
+void RigidFlowTracker::enableAdaptiveFeatures() {
+    m_adaptive_features = !m_adaptive_features;
+    m_of_tracker->setAdaptiveFeatures(m_adaptive_features);
+    Q_EMIT update();
+}
+
+/*
+* selects the estimator for the per frame transform
+*/
+void RigidFlowTracker::changeEstimator(int estimator) {
+    m_estimator = estimator;
+    m_of_tracker->setEstimator(m_estimator);
+    Q_EMIT update();
+}
+
+/*
+* selects the corner detector for new features
+*/
+void RigidFlowTracker::changeDetector(int detector) {
+    m_detector = detector;
+    m_of_tracker->setDetector(m_detector);
+    Q_EMIT update();
+}
+
 void RigidFlowTracker::switchToSATracking() {
     switchMode(false);
 }
@@ -626,16 +928,19 @@ void RigidFlowTracker::switchToATracking() {
 void RigidFlowTracker::switchMode(bool atracking) {
     m_automatictracking = atracking;
 
+    // both trackers are kept, the idle one only falls behind in settings and position
     if (!m_automatictracking) {
-        m_of_tracker = new SingleOFTracker();
-        reinterpret_cast<SingleOFTracker*>(m_of_tracker)->reset();
-        reinterpret_cast<SingleOFTracker*>(m_of_tracker)->configure(m_features);
-        reinterpret_cast<SingleOFTracker*>(m_of_tracker)->init(m_currentImage, *m_trackedObjects[m_cto].get<FlowBox>(m_currentFrame));
+        m_of_tracker = m_single_tracker.get();
+    } else {
+        m_of_tracker = m_overlap_tracker.get();
+    }
+    applySettings();
+    m_checkpoints.clear();
+    if (m_cto < static_cast<int>(m_tracks.size()) && m_tracks[m_cto].has(m_currentFrame)) {
+        FlowBox box = m_tracks[m_cto].get(m_currentFrame);
+        m_of_tracker->retarget(m_currentImage, box);
     } else {
-        m_of_tracker = new OverlapOFTracker();
-        reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->reset();
-        reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->configure(m_futuresteps, m_noncorrectionsteps, m_features, m_correction_enabled);
-        reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->init(m_currentImage, *m_trackedObjects[m_cto].get<FlowBox>(m_currentFrame));
+        m_of_tracker->reset();
     }
     m_noncorrectionstepsEdit->setDisabled(!m_automatictracking);
     m_enable_correction->setDisabled(!m_automatictracking);
@@ -650,35 +955,438 @@ void RigidFlowTracker::changeParams() {
     int temp1 = m_futurestepsEdit->text().toInt();
     int temp2 = m_featuresEdit->text().toInt();
     m_noncorrectionsteps = m_noncorrectionstepsEdit->text().toInt();
+    m_scheduler.setBudget(m_budgetEdit->text().toDouble());
+    updateQualityLabel();
     if (m_automatictracking) {
-        if (temp1 != m_futuresteps || temp2 != m_features) {
-            m_of_tracker = new OverlapOFTracker();
-        }
         m_futuresteps = temp1;
-        m_features = temp2;
-        reinterpret_cast<OverlapOFTracker*>(m_of_tracker)->configure(m_futuresteps, m_noncorrectionsteps, m_features, m_correction_enabled);
+    }
+    m_features = temp2;
+    // the trackers take the new values in place, a new number of future steps restarts the sets
+    configureTracker();
+    m_checkpoints.clear();
+    m_of_tracker->setQuality(m_scheduler.getQuality());
+}
+
+/*
+* restores the tracker at the frame before frame, or after it in semi-automatic mode, if a state of it is cached.
+* prevFrame is set to the frame the tracker continues from relative to frame.
+*/
+bool RigidFlowTracker::resume(size_t frame, cv::Mat &image, int &prevFrame) {
+    auto &object = m_tracks[m_cto];
+    const int steps[] = { -1, 1 };
+
+    for (int step : steps) {
+        if (step > 0 && m_automatictracking) break;
+        if (step < 0 && frame == 0) continue;
+
+        size_t from = frame + step;
+        if (!m_checkpoints.contains(m_cto, from) || !object.has(from)) continue;
+
+        if (!m_of_tracker->isInitialized()) {
+            applySettings();
+            m_of_tracker->init(image);
+        }
+        if (m_checkpoints.restore(m_cto, from, object.get(from), *m_of_tracker)) {
+            m_anchor = from;
+            prevFrame = step;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+* passes the current settings to the active tracker
+*/
+void RigidFlowTracker::applySettings() {
+    m_of_tracker->setRefinement(m_refinement);
+    m_of_tracker->setCoarseToFine(m_coarse_to_fine);
+    m_of_tracker->setAdaptiveFeatures(m_adaptive_features);
+    m_of_tracker->setQuality(m_scheduler.getQuality());
+    m_of_tracker->setEstimator(m_estimator);
+    m_of_tracker->setDetector(m_detector);
+    m_of_tracker->setFeatureMap(&m_feature_map);
+    configureTracker();
+}
+
+/*
+* passes the feature count, future steps and correction settings to the active tracker
+*/
+void RigidFlowTracker::configureTracker() {
+    if (!m_automatictracking) {
+        m_single_tracker->configure(m_features);
     } else {
-        m_features = temp2;
-        reinterpret_cast<SingleOFTracker*>(m_of_tracker)->configure(m_features);
+        m_overlap_tracker->configure(m_futuresteps, m_noncorrectionsteps, m_features, m_correction_enabled);
     }
 }
 
+/*
+* tracks the following frames again from the box of the current frame, e.g. after it was corrected.
+* Runs over the stored frames without playing the video and stops as soon as the new boxes agree
+* with the stored ones again or at the next box set by hand, the rest of the path is kept.
+*/
+void RigidFlowTracker::retrackForward() {
+    if (m_cto >= static_cast<int>(m_tracks.size())) return;
+
+    auto &object = m_tracks[m_cto];
+    size_t start = m_currentFrame;
+    if (!object.has(start)) return;
+
+    cv::Mat startImage;
+    if (!m_frames.image(start, startImage)) startImage = m_currentImage;
+    if (startImage.empty()) return;
+
+    applySettings();
+    FlowBox box = object.get(start);
+    m_of_tracker->retarget(startImage, box);
+    m_checkpoints.save(m_cto, start, box, *m_of_tracker);
+
+    const std::set<size_t> &keyframes = keyframesOf(m_cto);
+    int agreeing = 0;
+    for (size_t frame = start + 1; agreeing < RETRACK_CONVERGED_FRAMES; frame++) {
+        if (keyframes.count(frame)) break; // boxes set by hand are kept
+
+        cv::Mat image;
+        if (!m_frames.image(frame, image)) break; // the video has to be played from here on
+
+        box = object.get(frame - 1);
+        m_feature_map.setFrame(image);
+        m_of_tracker->next(image, box);
+
+        if (object.has(frame) && agree(object.get(frame), box)) {
+            agreeing++;
+        } else {
+            agreeing = 0;
+        }
+
+        object.set(frame, box);
+        m_checkpoints.save(m_cto, frame, box, *m_of_tracker);
+    }
+
+    // the tracker continues from the current frame again, the state of it may have been evicted meanwhile
+    if (!m_checkpoints.restore(m_cto, start, object.get(start), *m_of_tracker)) {
+        box = object.get(start);
+        m_of_tracker->retarget(startImage, box);
+    }
+    m_anchor = start;
+    m_stride = 1;
+    Q_EMIT update();
+}
+
+/*
+* frames of one direction tracked from a keyframe, in a thread of its own
+*/
+struct TrackingPass {
+    std::unique_ptr<OFTracker> tracker; // used by this pass only
+    size_t from; // keyframe
+    int step; // 1 forward, -1 backward
+    bool meets; // ends where the pass from the neighbouring keyframe ends
+    FlowBox start; // box at the keyframe
+    std::vector<cv::Mat> grays; // of from, from + step, ... as kept by the FrameStore
+    std::vector<FlowBox> boxes; // of from + step, ...
+    std::vector<float> support;
+    std::thread thread;
+
+    void run(const std::atomic<bool> &cancel) {
+        FlowBox box = start;
+        cv::Mat image;
+        FrameStore::toImage(grays[0], image);
+        tracker->init(image, box);
+        for (size_t i = 1; i < grays.size() && !cancel; i++) {
+            FrameStore::toImage(grays[i], image);
+            tracker->next(image, box);
+            boxes.push_back(box);
+            support.push_back(tracker->getSupport());
+        }
+    }
+};
+
+/*
+* tracks the current object from the box of the current frame into both directions over the stored frames.
+* Every direction runs in a thread of its own up to the neighbouring keyframe, a box set by hand. Between two
+* keyframes the passes from both ends meet halfway and are blended there by the support of their estimates.
+* The passes run in the background, finishBothWays() takes over their boxes.
+*/
+void RigidFlowTracker::trackBothWays() {
+    if (!m_passes.empty()) return; // still running
+    if (m_cto >= static_cast<int>(m_tracks.size())) return;
+
+    auto &object = m_tracks[m_cto];
+    size_t key = m_currentFrame;
+    if (!object.has(key)) return;
+
+    cv::Mat keyGray = m_frames.gray(key);
+    if (keyGray.empty() && !m_currentImage.empty()) cv::cvtColor(m_currentImage, keyGray, CV_BGR2GRAY);
+    if (keyGray.empty()) return;
+
+    std::set<size_t> &keys = keyframesOf(m_cto);
+    keys.insert(key);
+
+    // the stored frames around the keyframe
+    size_t first = key, last = key;
+    while (first > 0 && m_frames.contains(first - 1)) first--;
+    while (m_frames.contains(last + 1)) last++;
+
+    // the neighbouring keyframes among them
+    size_t prev = first, next = last;
+    bool hasPrev = false, hasNext = false;
+    for (size_t k : keys) {
+        if (!object.has(k)) continue;
+        if (k < key && k >= first) {
+            prev = k;
+            hasPrev = true;
+        }
+        if (k > key && k <= last && !hasNext) {
+            next = k;
+            hasNext = true;
+        }
+    }
+
+    auto addPass = [&](size_t from, size_t to, bool meets) {
+        if (from == to) return;
+
+        std::unique_ptr<TrackingPass> pass(new TrackingPass());
+        pass->tracker = createTracker();
+        pass->from = from;
+        pass->step = to > from ? 1 : -1;
+        pass->meets = meets;
+        pass->start = object.get(from);
+        for (size_t f = from; ; f += pass->step) {
+            pass->grays.push_back(f == key ? keyGray : m_frames.gray(f));
+            if (f == to) break;
+        }
+        m_passes.push_back(std::move(pass));
+    };
+
+    if (hasPrev) {
+        size_t middle = (prev + key) / 2;
+        if (key - prev > 1) {
+            addPass(prev, std::min(middle + BLEND_FRAMES, key - 1), true);
+            addPass(key, std::max(middle, prev + 1 + BLEND_FRAMES) - BLEND_FRAMES, true);
+        }
+    } else {
+        addPass(key, first, false);
+    }
+    if (hasNext) {
+        size_t middle = (key + next) / 2;
+        if (next - key > 1) {
+            addPass(key, std::min(middle + BLEND_FRAMES, next - 1), true);
+            addPass(next, std::max(middle, key + 1 + BLEND_FRAMES) - BLEND_FRAMES, true);
+        }
+    } else {
+        addPass(key, last, false);
+    }
+
+    if (m_passes.empty()) return;
+
+    m_passes_object = m_cto;
+    int run = ++m_passes_run;
+    m_cancel_passes = false;
+    m_running_passes = static_cast<int>(m_passes.size());
+    for (auto &pass : m_passes) {
+        TrackingPass *p = pass.get();
+        p->thread = std::thread([this, p, run] {
+            p->run(m_cancel_passes);
+            // the last pass hands the results over to the gui thread
+            if (--m_running_passes == 0) {
+                QMetaObject::invokeMethod(this, "finishBothWays", Qt::QueuedConnection, Q_ARG(int, run));
+            }
+        });
+    }
+}
+
+/*
+* blends the boxes of the passes of run into the path, once all of them are done
+*/
+void RigidFlowTracker::finishBothWays(int run) {
+    if (run != m_passes_run || m_passes.empty()) return; // cancelled meanwhile
+
+    for (auto &pass : m_passes) {
+        pass->thread.join();
+    }
+
+    auto &object = m_tracks[m_passes_object];
+    const std::set<size_t> &keys = keyframesOf(m_passes_object);
+
+    // weighted sums per frame, passes that meet fade out towards their end
+    struct Blend { double x, y, w, h, sin, cos, weight; };
+    std::map<size_t, Blend> blends;
+    for (auto &pass : m_passes) {
+        size_t n = pass->boxes.size();
+        for (size_t i = 0; i < n; i++) {
+            const FlowBox &box = pass->boxes[i];
+            double ramp = pass->meets ? std::min(1.0, (n - i) / (2.0 * BLEND_FRAMES + 2)) : 1.0;
+            double weight = ramp * (pass->support[i] + BLEND_MIN_SUPPORT);
+            double phi = box.phi * CV_PI / 180;
+
+            size_t frame = pass->step > 0 ? pass->from + i + 1 : pass->from - i - 1;
+            Blend &blend = blends.emplace(frame, Blend()).first->second;
+            blend.x += weight * box.x;
+            blend.y += weight * box.y;
+            blend.w += weight * box.w;
+            blend.h += weight * box.h;
+            blend.sin += weight * sin(phi);
+            blend.cos += weight * cos(phi);
+            blend.weight += weight;
+        }
+    }
+    m_passes.clear();
+
+    for (auto &entry : blends) {
+        // boxes set by hand while the passes ran are kept
+        if (keys.count(entry.first)) continue;
+
+        const Blend &blend = entry.second;
+        float phi = static_cast<float>(fmod(atan2(blend.sin, blend.cos) * 180 / CV_PI + 360, 360));
+        object.set(entry.first, FlowBox(
+                       static_cast<float>(blend.x / blend.weight), static_cast<float>(blend.y / blend.weight),
+                       static_cast<float>(blend.w / blend.weight), static_cast<float>(blend.h / blend.weight), phi));
+    }
+
+    Q_EMIT update();
+}
+
+/*
+* stops the passes of trackBothWays() and drops their results, e.g. before their object goes away
+*/
+void RigidFlowTracker::cancelBothWays() {
+    m_cancel_passes = true;
+    for (auto &pass : m_passes) {
+        if (pass->thread.joinable()) pass->thread.join();
+    }
+    m_passes.clear();
+}
+
+/*
+* a tracker of the current mode and settings, for tracking apart from the active one
+*/
+std::unique_ptr<OFTracker> RigidFlowTracker::createTracker() const {
+    std::unique_ptr<OFTracker> tracker;
+    if (!m_automatictracking) {
+        auto *single = new SingleOFTracker();
+        single->configure(m_features);
+        tracker.reset(single);
+    } else {
+        auto *overlap = new OverlapOFTracker();
+        overlap->configure(m_futuresteps, m_noncorrectionsteps, m_features, m_correction_enabled);
+        tracker.reset(overlap);
+    }
+    // no FeatureMap, it belongs to the frames of the GUI thread
+    tracker->setRefinement(m_refinement);
+    tracker->setCoarseToFine(m_coarse_to_fine);
+    tracker->setAdaptiveFeatures(m_adaptive_features);
+    tracker->setEstimator(m_estimator);
+    tracker->setDetector(m_detector);
+    return tracker;
+}
+
+/*
+* frames of object whose box was set by hand
+*/
+std::set<size_t> &RigidFlowTracker::keyframesOf(int object) {
+    if (object >= static_cast<int>(m_keyframes.size())) {
+        m_keyframes.resize(object + 1);
+    }
+    return m_keyframes[object];
+}
+
+/*
+* whether two boxes of the same frame are equal within the re-tracking tolerance
+*/
+bool RigidFlowTracker::agree(const FlowBox &a, const FlowBox &b) {
+    float dphi = static_cast<float>(fmod(a.phi - b.phi + 540, 360) - 180);
+    return std::abs(a.x - b.x) < RETRACK_TOLERANCE && std::abs(a.y - b.y) < RETRACK_TOLERANCE &&
+           std::abs(dphi) < RETRACK_TOLERANCE && a.w == b.w && a.h == b.h;
+}
 
 /*
 * deletes currently selected trackedObject
 */
 void RigidFlowTracker::deletePath() {
-    if(m_cto < static_cast<int>(m_trackedObjects.size())){
-        m_trackedObjects.erase(m_trackedObjects.begin() + m_cto);
-        if(m_cto == static_cast<int>(m_trackedObjects.size()) && m_cto > 0){
-            m_cto--;
+    if(m_cto < static_cast<int>(m_tracks.size())){
+        cancelBothWays();
+        m_tracks.erase(m_tracks.begin() + m_cto);
+        // the following objects move down, their checkpoints would belong to others
+        m_checkpoints.clear();
+        if(m_cto < static_cast<int>(m_keyframes.size())){
+            m_keyframes.erase(m_keyframes.begin() + m_cto);
         }
-        for(size_t i = m_cto; i < m_trackedObjects.size(); i++){
-            m_trackedObjects[i].setId(i);
+        if(m_cto == static_cast<int>(m_tracks.size()) && m_cto > 0){
+            m_cto--;
         }
-        if(m_trackedObjects.size() == 0){
+        if(m_tracks.size() == 0){
             m_rectstat = RS_NOT_SET;
         }
         Q_EMIT update();
     }
+}
+
+void RigidFlowTracker::saveTracks() {
+    QString path = QFileDialog::getSaveFileName(getToolsWidget(), "Save Trajectories", QString(), TRACK_FILE_FILTER);
+    if(path.isEmpty()) return;
+
+    if(m_tmpFlowBox) {
+        m_tmpFlowBox = false;
+        m_tracks[m_cto].erase(m_currentFrame);
+    }
+
+    // saving to the loaded file only writes the changed chunks
+    bool saved = path.endsWith(".json", Qt::CaseInsensitive) ?
+                 TrackFile::writeJson(path.toStdString(), m_tracks) :
+                 m_track_file.save(path.toStdString(), m_tracks);
+    if(saved) return;
+
+    // the file was written, but the old one couldn't be replaced. The tracks now read from the temporary file.
+    QString tmp = path + ".tmp";
+    if(m_track_file.isOpen() && QString::fromStdString(m_track_file.path()) == tmp) {
+        QMessageBox::warning(getToolsWidget(), "Save Trajectories",
+                             "Could not replace " + path + ", the trajectories were saved to " + tmp + ".");
+    } else {
+        QMessageBox::warning(getToolsWidget(), "Save Trajectories", "Could not save the trajectories to " + path + ".");
+    }
+}
+
+void RigidFlowTracker::loadTracks() {
+    QString path = QFileDialog::getOpenFileName(getToolsWidget(), "Load Trajectories", QString(), TRACK_FILE_FILTER);
+    if(path.isEmpty()) return;
+
+    // binary files are mapped, their boxes are read when they are shown or tracked from
+    bool loaded = path.endsWith(".json", Qt::CaseInsensitive) ?
+                  TrackFile::readJson(path.toStdString(), m_tracks) :
+                  m_track_file.load(path.toStdString(), m_tracks);
+    if(!loaded) {
+        QMessageBox::warning(getToolsWidget(), "Load Trajectories", "Could not read trajectories from " + path + ".");
+        return;
+    }
+
+    cancelBothWays();
+    m_tmpFlowBox = false;
+    m_keyframes.clear();
+    m_checkpoints.clear();
+    m_cto = 0;
+    m_rectstat = m_tracks.size() > 0 ? RS_INITIALIZE : RS_NOT_SET;
+    Q_EMIT update();
+}
+
+/* converts a trajectory file between JSON and the binary format without loading it */
+void RigidFlowTracker::convertTracks() {
+    QString from = QFileDialog::getOpenFileName(getToolsWidget(), "Convert Trajectories", QString(), TRACK_FILE_FILTER);
+    if(from.isEmpty()) return;
+
+    bool json = from.endsWith(".json", Qt::CaseInsensitive);
+    QString to = QFileDialog::getSaveFileName(getToolsWidget(), "Save Converted Trajectories", QString(),
+                                              json ? "Trajectories (*.rft)" : "JSON (*.json)");
+    if(to.isEmpty()) return;
+
+    // the loaded file is mapped, the tracks read from it
+    if(m_track_file.isOpen() && QString::fromStdString(m_track_file.path()) == to) {
+        QMessageBox::warning(getToolsWidget(), "Convert Trajectories", to + " is loaded, save the trajectories instead.");
+        return;
+    }
+
+    bool converted = json ? TrackFile::jsonToBinary(from.toStdString(), to.toStdString()) :
+                            TrackFile::binaryToJson(from.toStdString(), to.toStdString());
+    if(!converted) {
+        QMessageBox::warning(getToolsWidget(), "Convert Trajectories", "Could not convert " + from + " to " + to + ".");
+    }
 }
\ No newline at end of file
@@ -1,9 +1,16 @@
 ﻿#pragma once
 
+#include "CheckpointCache.h"
+#include "FeatureMap.h"
+#include "FrameScheduler.h"
+#include "FrameStore.h"
 #include "OverlapOFTracker.h"
 #include "SingleOFTracker.h"
+#include "TrackFile.h"
+#include "TrackStore.h"
 
 #include <QCheckBox>
+#include <QComboBox>
 #include <QFormLayout>
 #include <QGroupBox>
 #include <QLineEdit>
@@ -19,11 +26,16 @@
 #include <opencv2/video/tracking.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <ctype.h>
+#include <atomic>
+#include <memory>
+
+struct TrackingPass;
 
 class RigidFlowTracker : public BioTracker::Core::TrackingAlgorithm {
     Q_OBJECT
   public:
     RigidFlowTracker(BioTracker::Core::Settings &settings);
+    ~RigidFlowTracker();
 
     void track(size_t frameNumber, const cv::Mat &frame) override;
     void paint(size_t frameNumber, BioTracker::Core::ProxyMat &m, View const &view = OriginalView) override;
@@ -54,6 +66,15 @@ class RigidFlowTracker : public BioTracker::Core::TrackingAlgorithm {
     int                         m_futuresteps;
     int                         m_noncorrectionsteps;
     bool                        m_correction_enabled;
+    bool                        m_refinement;
+    bool                        m_coarse_to_fine;
+    bool                        m_adaptive_features;
+    bool                        m_adaptive_stride;
+    int                         m_stride; // frames between two tracked frames
+    size_t                      m_anchor; // last tracked frame, the current stride started at it
+    cv::Mat                     m_anchorImage;
+    int                         m_estimator;
+    int                         m_detector;
     int                         m_features;
     bool                        m_automatictracking;
     bool                        m_updatefeatures;
@@ -74,9 +95,24 @@ class RigidFlowTracker : public BioTracker::Core::TrackingAlgorithm {
     int                         m_rectstat;
     double                      m_rotation;
 
-    OFTracker*                  m_of_tracker;
+    std::unique_ptr<SingleOFTracker>  m_single_tracker; // semi-automatic tracking
+    std::unique_ptr<OverlapOFTracker> m_overlap_tracker; // automatic tracking
+    OFTracker*                  m_of_tracker; // the active one of the two above
+    FeatureMap                  m_feature_map; // detection shared by the trackers of a frame
+    FrameScheduler              m_scheduler; // real-time mode
+    CheckpointCache             m_checkpoints; // tracker states of recent frames for scrubbing
+    FrameStore                  m_frames; // every frame track() has seen, for tracking them again
+    std::vector<std::set<size_t> > m_keyframes; // per object the frames whose box was set by hand
+    std::vector<std::unique_ptr<TrackingPass> > m_passes; // of trackBothWays(), each one running in a thread
+    std::atomic<int>            m_running_passes;
+    std::atomic<bool>           m_cancel_passes;
+    int                         m_passes_object; // the passes track
+    int                         m_passes_run; // counts the calls of trackBothWays(), finishing tells them apart
     int                      m_cto;
 
+    TrackFile                   m_track_file; // binary file the track stores may read from, outlives them
+
+    std::vector<TrackStore>     m_tracks; // boxes of the tracked objects, m_trackedObjects is only filled for saving
     std::set<Qt::Key>	        m_grabbedKeys;
 
     // as we want to adapt the values of this class all the time we need to
@@ -86,6 +122,8 @@ class RigidFlowTracker : public BioTracker::Core::TrackingAlgorithm {
     QCheckBox   *			m_enable_correction;
     QLineEdit   *           m_featuresEdit;
     QCheckBox   *           m_fixedratioEdit;
+    QLineEdit   *           m_budgetEdit;
+    QLabel      *           m_qualityLabel;
 
   private Q_SLOTS:
     void switchToATracking();
@@ -93,10 +131,33 @@ class RigidFlowTracker : public BioTracker::Core::TrackingAlgorithm {
     void fixRatio();
     void changeParams();
     void enableCorrection();
+    void enableRefinement();
+    void enableCoarseToFine();
+    void enableAdaptiveFeatures();
+    void enableAdaptiveStride();
+    void updateQualityLabel();
+    bool holdPose(size_t frame, const cv::Mat &image);
+    void adaptStride(size_t frame, const cv::Mat &image);
+    void changeEstimator(int estimator);
+    void changeDetector(int detector);
     void showPath();
     void deletePath();
+    void retrackForward();
+    void trackBothWays();
+    void finishBothWays(int run);
+    void releaseTrackedObjects();
+    void saveTracks();
+    void loadTracks();
+    void convertTracks();
 
     void switchMode(bool atracking);
+    bool resume(size_t frame, cv::Mat &image, int &prevFrame);
+    static bool agree(const FlowBox &a, const FlowBox &b);
+    void cancelBothWays();
+    std::unique_ptr<OFTracker> createTracker() const;
+    std::set<size_t> &keyframesOf(int object);
+    void applySettings();
+    void configureTracker();
     bool clickInsideRectangle(std::vector<cv::Point2i> pts, QMouseEvent *e);
     void drawPath(QPainter *painter);
     void drawRectangle(QPainter *painter, size_t frame);
@@ -0,0 +1,56 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "RigidTransform.h"
+
+cv::Point2f applyRigidTransform(const cv::Point3f &T, const cv::Point2f &p)
+{
+	float a = T.z * float(M_PI) / 180;
+	float cosa = cos(a), sina = sin(a);
+
+	return cv::Point2f(cosa * p.x + sina * p.y + T.x, -sina * p.x + cosa * p.y + T.y);
+}
+
+/*
+* Weighted least squares fit (Procrustes) of the rigid transform mapping from onto to.
+* Closed form: the rotation follows from the weighted cross covariance of the centered point sets,
+* the translation from the weighted centroids.
+* Needs at least two distinct points with positive weight, returns the identity otherwise.
+*/
+cv::Point3f fitRigidTransform(const Points &from, const Points &to, const std::vector<float> &weights)
+{
+	double sw = 0;
+	cv::Point2d mf(0, 0), mt(0, 0);
+
+	for (int i = 0; i < static_cast<int>(from.size()); i++)
+	{
+		sw += weights[i];
+		mf += cv::Point2d(from[i]) * weights[i];
+		mt += cv::Point2d(to[i]) * weights[i];
+	}
+
+	if (sw <= 0) return cv::Point3f(0, 0, 0);
+
+	mf *= 1.0 / sw;
+	mt *= 1.0 / sw;
+
+	// maximize sum w * b.(A a) = cos(phi) * C + sin(phi) * S
+	double C = 0, S = 0;
+	for (int i = 0; i < static_cast<int>(from.size()); i++)
+	{
+		cv::Point2d a = cv::Point2d(from[i]) - mf;
+		cv::Point2d b = cv::Point2d(to[i]) - mt;
+
+		C += weights[i] * (a.x * b.x + a.y * b.y);
+		S += weights[i] * (b.x * a.y - b.y * a.x);
+	}
+
+	if (C == 0 && S == 0) return cv::Point3f(0, 0, 0);
+
+	cv::Point3f T(0, 0, static_cast<float>(atan2(S, C) * 180 / M_PI));
+	cv::Point2f t = cv::Point2f(mt) - applyRigidTransform(T, cv::Point2f(mf));
+	T.x = t.x;
+	T.y = t.y;
+
+	return T;
+}
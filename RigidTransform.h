@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+typedef std::vector<cv::Point2f> Points;
+
+/*
+* Rigid 2D transforms T = (tx, ty, phi) in the convention of the HoughHash:
+* to = A(phi) * from + t with A(phi) = (cos sin; -sin cos) and phi in degrees.
+*/
+cv::Point2f applyRigidTransform(const cv::Point3f &T, const cv::Point2f &p);
+cv::Point3f fitRigidTransform(const Points &from, const Points &to, const std::vector<float> &weights);
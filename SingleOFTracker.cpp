@@ -1,5 +1,7 @@
 #include "SingleOFTracker.h"
 
+#define REPLENISH_RATIO 0.7 // share of live features below which new ones are detected
+
 SingleOFTracker::SingleOFTracker()
 :
 need_features(true),
@@ -9,8 +11,8 @@ iterator_pos(0)
 {
 	points[0] = std::vector<cv::Point2f>();
 	points[1] = std::vector<cv::Point2f>();
-	status = std::vector<char>();
-	error = std::vector<float>();
+	status = Statuses();
+	error = Errors();
 }
 
 SingleOFTracker::~SingleOFTracker()
@@ -18,9 +20,12 @@ SingleOFTracker::~SingleOFTracker()
 	deInit();
 }
 
+/*
+* A changed feature count takes effect in track(), which trims or tops up the tracked features
+* to the budget. Detecting a new set here would pair it with the old points of the previous frame.
+*/
 void SingleOFTracker::configure(int n)
 {
-	if(n != nfeatures) need_features = true;
 	OFTracker::configure(n, false, -1);
 }
 
@@ -43,13 +48,51 @@ void SingleOFTracker::init(cv::Mat &frame, FlowBox &bb)
 
     OFTracker::init(frame, bb);
 
-    if (need_features) {
-        if(findFeatures(points[1], true))
-        {
-            need_features = false;
-            swap = false;
-        }
-    }
+    seed();
+}
+
+/*
+* Drops the tracked points and detects new ones in the current frame
+*/
+void SingleOFTracker::restart()
+{
+	points[0].clear();
+	points[1].clear();
+	need_features = true;
+
+	seed();
+}
+
+void SingleOFTracker::savePoints(TrackerState &state) const
+{
+	state.points.push_back(points[0]);
+	state.points.push_back(points[1]);
+	state.values.push_back(need_features);
+	state.values.push_back(swap);
+}
+
+bool SingleOFTracker::restorePoints(const TrackerState &state)
+{
+	if (state.points.size() != 2 || state.values.size() != 2) return false;
+
+	points[0] = state.points[0];
+	points[1] = state.points[1];
+	need_features = state.values[0] != 0;
+	swap = state.values[1] != 0;
+	iterator_initialized = false;
+
+	return true;
+}
+
+void SingleOFTracker::seed()
+{
+	if (need_features) {
+		if(findFeatures(points[1], true))
+		{
+			need_features = false;
+			swap = false;
+		}
+	}
 }
 
 void SingleOFTracker::reset()
@@ -82,14 +125,46 @@ bool SingleOFTracker::track()
 		return false;
 	}
 	else {
-		bool r = trackFeatures(points[!swap], points[swap], status, error);
+		// the latest points belong to the previous frame by now
+		Points &current = points[!swap];
+		if (static_cast<int>(current.size()) > nfeatures)
+			current.resize(nfeatures); // the budget shrank, the newest features go first
+		else if (current.size() < REPLENISH_RATIO * nfeatures)
+			addFeatures(current, nfeatures - static_cast<int>(current.size()), true);
+
+		bool r = trackFeatures(current, points[swap], status, error);
+		compact(current, points[swap]);
 		swap = !swap;
 		return r;
 	}	
 }
 
+/*
+* drops the correspondences the optical flow lost, keeps the errors in line
+*/
+void SingleOFTracker::compact(Points &points_old, Points &points_new)
+{
+	int live = 0;
+
+	for (int i = 0; i < static_cast<int>(points_new.size()); i++)
+	{
+		if (!status[i]) continue;
+
+		points_old[live] = points_old[i];
+		points_new[live] = points_new[i];
+		error[live] = error[i];
+		status[live] = status[i];
+		live++;
+	}
+
+	points_old.resize(live);
+	points_new.resize(live);
+	error.resize(live);
+	status.resize(live);
+}
+
 
-bool SingleOFTracker::iteratePoints(cv::Point2f &p1, cv::Point2f &p2)
+bool SingleOFTracker::iteratePoints(cv::Point2f &p1, cv::Point2f &p2, float &error)
 {
 	if(!isInitialized() || need_features) return false;
 
@@ -107,6 +182,7 @@ bool SingleOFTracker::iteratePoints(cv::Point2f &p1, cv::Point2f &p2)
 	
 	p1 = points[swap][iterator_pos];
 	p2 = points[!swap][iterator_pos];
+	error = this->error[iterator_pos];
 	
 	iterator_pos++;
 	
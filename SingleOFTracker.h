@@ -6,8 +6,8 @@ class SingleOFTracker : public OFTracker
 {
 private:
 	std::vector<cv::Point2f> points[2];
-	std::vector<char> status;
-	std::vector<float> error;
+	Statuses status;
+	Errors error;
 
 	bool need_features;
 	bool swap;
@@ -26,6 +26,13 @@ public:
 protected:
 	void deInit();
 	virtual bool track()  override;
+	virtual void restart() override;
+	virtual void savePoints(TrackerState &state) const override;
+	virtual bool restorePoints(const TrackerState &state) override;
 	virtual void correct(FlowBox&) override {}
-	virtual bool iteratePoints(cv::Point2f &p1, cv::Point2f &p2) override;
+	virtual bool iteratePoints(cv::Point2f &p1, cv::Point2f &p2, float &error) override;
+
+private:
+	void seed();
+	void compact(Points &points_old, Points &points_new);
 };
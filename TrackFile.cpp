@@ -0,0 +1,345 @@
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <boost/interprocess/exceptions.hpp>
+#include <cereal/archives/json.hpp>
+#include <cereal/types/memory.hpp>
+#include <cereal/types/polymorphic.hpp>
+#include <cereal/types/vector.hpp>
+
+#include "TrackFile.h"
+
+#define JSON_NAME "trackedObjects" // of the vector of TrackedObjects in JSON files
+
+using namespace boost::interprocess;
+
+TrackFile::TrackFile()
+:
+entries(NULL),
+objects(0)
+{
+}
+
+/*
+* Maps the file at path for reading and saving changes.
+* Returns false if it can't be mapped or is no trajectory file, the file that is open stays open then.
+*/
+bool TrackFile::open(const std::string &path)
+{
+	file_mapping m;
+	mapped_region r;
+	try
+	{
+		file_mapping(path.c_str(), read_write).swap(m);
+		mapped_region(m, read_write).swap(r);
+	}
+	catch (const interprocess_exception &)
+	{
+		return false;
+	}
+
+	const char *base = static_cast<const char*>(r.get_address());
+	size_t size = r.get_size();
+	if (size < sizeof(Header)) return false;
+
+	const Header *header = reinterpret_cast<const Header*>(base);
+	if (memcmp(header->magic, TRACK_FILE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACK_FILE_VERSION ||
+		header->chunk_size != TRACK_CHUNK_SIZE || header->objects > (size - sizeof(Header)) / sizeof(Entry))
+		return false;
+
+	const Entry *e = reinterpret_cast<const Entry*>(base + sizeof(Header));
+	for (uint64_t i = 0; i < header->objects; i++)
+	{
+		if (e[i].table > size || e[i].chunks > (size - e[i].table) / sizeof(uint64_t))
+			return false;
+
+		// every chunk must lie within the file and count as many boxes as it has
+		const uint64_t *table = reinterpret_cast<const uint64_t*>(base + e[i].table);
+		for (uint64_t c = 0; c < e[i].chunks; c++)
+		{
+			if (!table[c]) continue;
+			if (size < sizeof(TrackStore::Chunk) || table[c] > size - sizeof(TrackStore::Chunk) || table[c] % sizeof(uint64_t))
+				return false;
+
+			const TrackStore::Chunk *chunk = reinterpret_cast<const TrackStore::Chunk*>(base + table[c]);
+			size_t present = 0;
+			for (size_t w = 0; w < sizeof(chunk->present) / sizeof(chunk->present[0]); w++)
+				present += std::bitset<64>(chunk->present[w]).count();
+			if (chunk->count < 0 || static_cast<size_t>(chunk->count) != present)
+				return false;
+		}
+	}
+
+	mapping.swap(m);
+	region.swap(r);
+	entries = e;
+	objects = static_cast<size_t>(header->objects);
+	file_path = path;
+	return true;
+}
+
+/*
+* Unmaps the file, tracks attached to it must not be used anymore
+*/
+void TrackFile::close()
+{
+	mapped_region().swap(region);
+	file_mapping().swap(mapping);
+	entries = NULL;
+	objects = 0;
+	file_path.clear();
+}
+
+bool TrackFile::isOpen() const
+{
+	return entries != NULL;
+}
+
+const std::string & TrackFile::path() const
+{
+	return file_path;
+}
+
+size_t TrackFile::objectCount() const
+{
+	return objects;
+}
+
+size_t TrackFile::chunks(size_t object) const
+{
+	return object < objects ? static_cast<size_t>(entries[object].chunks) : 0;
+}
+
+/*
+* Returns chunk index of object in the mapped file, NULL if it has no boxes
+*/
+const TrackStore::Chunk * TrackFile::chunk(size_t object, size_t index) const
+{
+	uint64_t offset = tableEntry(object, index);
+	size_t size = region.get_size();
+	if (!offset || size < sizeof(TrackStore::Chunk) || offset > size - sizeof(TrackStore::Chunk)) return NULL;
+
+	return reinterpret_cast<const TrackStore::Chunk*>(static_cast<const char*>(region.get_address()) + offset);
+}
+
+/*
+* Saves tracks to path. If tracks are attached to this file at path, only their changed chunks are
+* written into the mapping. Otherwise the file is written anew and tracks are attached to it.
+*/
+bool TrackFile::save(const std::string &path, std::vector<TrackStore> &tracks)
+{
+	if (isOpen() && path == file_path && saveChanges(tracks)) return true;
+
+	// tracks may still read from the mapping while the new file is written
+	std::string tmp = path + ".tmp";
+	if (!write(tmp, tracks))
+	{
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	// the old mapping is only given up once the tracks are attached to the new file
+	if (!load(tmp, tracks))
+	{
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	// a mapped file stays valid when it is renamed. Where existing files can't be replaced,
+	// the old one isn't mapped anymore and can be removed first.
+	if (std::rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		std::remove(path.c_str());
+		if (std::rename(tmp.c_str(), path.c_str()) != 0) return false; // the tracks stay attached to tmp
+	}
+
+	file_path = path;
+	return true;
+}
+
+/*
+* Opens the file at path and attaches one track per object to it, boxes are read when they are accessed
+*/
+bool TrackFile::load(const std::string &path, std::vector<TrackStore> &tracks)
+{
+	if (!open(path)) return false;
+
+	tracks.clear();
+	tracks.resize(objects);
+	for (size_t i = 0; i < objects; i++)
+		tracks[i].attach(this, i);
+
+	return true;
+}
+
+/*
+* Writes a new file with all boxes of tracks
+*/
+bool TrackFile::write(const std::string &path, const std::vector<TrackStore> &tracks)
+{
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+
+	Header header;
+	memcpy(header.magic, TRACK_FILE_MAGIC, sizeof(header.magic));
+	header.version = TRACK_FILE_VERSION;
+	header.chunk_size = TRACK_CHUNK_SIZE;
+	header.objects = tracks.size();
+
+	// the chunk tables follow the entries, the chunks follow the tables
+	std::vector<Entry> e(tracks.size());
+	uint64_t offset = sizeof(Header) + tracks.size() * sizeof(Entry);
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		e[i].chunks = tracks[i].chunkCount();
+		e[i].table = offset;
+		offset += e[i].chunks * sizeof(uint64_t);
+	}
+
+	std::vector<uint64_t> table;
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		for (size_t c = 0; c < tracks[i].chunkCount(); c++)
+		{
+			const TrackStore::Chunk *chunk = tracks[i].chunk(c);
+			bool stored = chunk && chunk->count > 0;
+			table.push_back(stored ? offset : 0);
+			if (stored) offset += sizeof(TrackStore::Chunk);
+		}
+	}
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	if (!e.empty()) out.write(reinterpret_cast<const char*>(&e[0]), e.size() * sizeof(Entry));
+	if (!table.empty()) out.write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(uint64_t));
+
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		for (size_t c = 0; c < tracks[i].chunkCount(); c++)
+		{
+			const TrackStore::Chunk *chunk = tracks[i].chunk(c);
+			if (chunk && chunk->count > 0) out.write(reinterpret_cast<const char*>(chunk), sizeof(TrackStore::Chunk));
+		}
+	}
+
+	return out.good();
+}
+
+/*
+* Writes tracks as JSON, a vector of TrackedObjects as cereal serializes them
+*/
+bool TrackFile::writeJson(const std::string &path, const std::vector<TrackStore> &tracks)
+{
+	std::vector<BioTracker::Core::TrackedObject> tracked;
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		BioTracker::Core::TrackedObject object(i);
+		tracks[i].toTrackedObject(object);
+		tracked.push_back(object);
+	}
+
+	std::ofstream out(path.c_str());
+	if (!out) return false;
+	{
+		cereal::JSONOutputArchive ar(out);
+		ar(cereal::make_nvp(JSON_NAME, tracked));
+	}
+	return out.good();
+}
+
+/*
+* Replaces tracks by those of a JSON file written by writeJson()
+*/
+bool TrackFile::readJson(const std::string &path, std::vector<TrackStore> &tracks)
+{
+	std::ifstream in(path.c_str());
+	if (!in) return false;
+
+	std::vector<BioTracker::Core::TrackedObject> tracked;
+	try
+	{
+		cereal::JSONInputArchive ar(in);
+		ar(cereal::make_nvp(JSON_NAME, tracked));
+	}
+	catch (const cereal::Exception &)
+	{
+		return false;
+	}
+
+	tracks.clear();
+	tracks.resize(tracked.size());
+	for (size_t i = 0; i < tracked.size(); i++)
+		tracks[i].fromTrackedObject(tracked[i]);
+
+	return true;
+}
+
+bool TrackFile::jsonToBinary(const std::string &json, const std::string &binary)
+{
+	std::vector<TrackStore> tracks;
+	return readJson(json, tracks) && write(binary, tracks);
+}
+
+bool TrackFile::binaryToJson(const std::string &binary, const std::string &json)
+{
+	TrackFile file;
+	std::vector<TrackStore> tracks;
+	return file.load(binary, tracks) && writeJson(json, tracks);
+}
+
+/*
+* Writes the changed chunks of tracks into the mapping. Returns false without writing anything
+* if the tracks don't fit the file anymore, e.g. objects were added or boxes were added to new chunks.
+*/
+bool TrackFile::saveChanges(std::vector<TrackStore> &tracks)
+{
+	if (tracks.size() != objects) return false;
+
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		if (!tracks[i].isAttachedTo(this, i)) return false;
+
+		for (size_t c = 0; c < tracks[i].chunkCount(); c++)
+		{
+			if (tracks[i].isDirty(c) && tracks[i].chunk(c) && !writableChunk(i, c)) return false;
+		}
+	}
+
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		for (size_t c = 0; c < tracks[i].chunkCount(); c++)
+		{
+			TrackStore::Chunk *stored = tracks[i].isDirty(c) ? writableChunk(i, c) : NULL;
+			if (!stored) continue;
+
+			const TrackStore::Chunk *chunk = tracks[i].chunk(c);
+			if (chunk)
+			{
+				memcpy(stored, chunk, sizeof(TrackStore::Chunk));
+			}
+			else
+			{
+				memset(stored->present, 0, sizeof(stored->present));
+				stored->count = 0;
+			}
+		}
+		tracks[i].markSaved();
+	}
+
+	region.flush();
+	return true;
+}
+
+TrackStore::Chunk * TrackFile::writableChunk(size_t object, size_t index)
+{
+	return const_cast<TrackStore::Chunk*>(chunk(object, index));
+}
+
+uint64_t TrackFile::tableEntry(size_t object, size_t index) const
+{
+	if (object >= objects || index >= entries[object].chunks) return 0;
+
+	const char *base = static_cast<const char*>(region.get_address());
+	return reinterpret_cast<const uint64_t*>(base + entries[object].table)[index];
+}
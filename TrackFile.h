@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "TrackStore.h"
+
+#define TRACK_FILE_MAGIC "RFTRACKS"
+#define TRACK_FILE_VERSION 1
+
+/*
+* Binary trajectory file of several objects, memory mapped for reading and for saving changes.
+* Layout, native byte order, all offsets from the start of the file:
+*   Header
+*   Entry per object: number of chunks and offset of its chunk table
+*   chunk table per object: offset of each chunk, 0 for chunks without boxes
+*   chunks: TrackStore::Chunk records, the columns of TRACK_CHUNK_SIZE frames and their presence bits
+* A box is found by frame in O(1) through the chunk table of its object.
+*/
+class TrackFile
+{
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t chunk_size; // frames per chunk
+		uint64_t objects;
+	};
+
+	struct Entry
+	{
+		uint64_t chunks;
+		uint64_t table; // offset of the chunk table
+	};
+
+	boost::interprocess::file_mapping mapping;
+	boost::interprocess::mapped_region region;
+	std::string file_path;
+	const Entry *entries;
+	size_t objects;
+
+public:
+	TrackFile();
+	bool open(const std::string &path);
+	void close();
+	bool isOpen() const;
+	const std::string & path() const;
+	size_t objectCount() const;
+	size_t chunks(size_t object) const;
+	const TrackStore::Chunk * chunk(size_t object, size_t index) const;
+
+	bool save(const std::string &path, std::vector<TrackStore> &tracks);
+	bool load(const std::string &path, std::vector<TrackStore> &tracks);
+
+	static bool write(const std::string &path, const std::vector<TrackStore> &tracks);
+	static bool writeJson(const std::string &path, const std::vector<TrackStore> &tracks);
+	static bool readJson(const std::string &path, std::vector<TrackStore> &tracks);
+	static bool jsonToBinary(const std::string &json, const std::string &binary);
+	static bool binaryToJson(const std::string &binary, const std::string &json);
+
+private:
+	bool saveChanges(std::vector<TrackStore> &tracks);
+	TrackStore::Chunk * writableChunk(size_t object, size_t index);
+	uint64_t tableEntry(size_t object, size_t index) const;
+};
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstring>
+
+#include "TrackFile.h"
+#include "TrackStore.h"
+
+#define ARENA_BLOCK_CHUNKS 16 // chunks the arena grows by
+
+TrackStore::TrackStore()
+:
+file(NULL),
+file_object(0),
+boxes(0),
+last(0)
+{
+}
+
+bool TrackStore::has(size_t frame) const
+{
+	const Chunk *c = chunk(frame / TRACK_CHUNK_SIZE);
+	if (!c) return false;
+
+	size_t i = frame % TRACK_CHUNK_SIZE;
+	return (c->present[i / 64] >> (i % 64)) & 1;
+}
+
+/*
+* Returns the box of frame, a default box if there is none
+*/
+FlowBox TrackStore::get(size_t frame) const
+{
+	if (!has(frame)) return FlowBox();
+
+	const Chunk &c = *chunk(frame / TRACK_CHUNK_SIZE);
+	size_t i = frame % TRACK_CHUNK_SIZE;
+	return FlowBox(c.x[i], c.y[i], c.w[i], c.h[i], c.phi[i]);
+}
+
+/*
+* Adds or replaces the box of frame
+*/
+void TrackStore::set(size_t frame, const FlowBox &bb)
+{
+	Chunk &c = *modify(frame / TRACK_CHUNK_SIZE);
+	size_t i = frame % TRACK_CHUNK_SIZE;
+	c.x[i] = bb.x;
+	c.y[i] = bb.y;
+	c.w[i] = bb.w;
+	c.h[i] = bb.h;
+	c.phi[i] = bb.phi;
+
+	uint64_t bit = uint64_t(1) << (i % 64);
+	if (!(c.present[i / 64] & bit))
+	{
+		c.present[i / 64] |= bit;
+		c.count++;
+		boxes++;
+		if (boxes == 1 || frame > last) last = frame;
+	}
+}
+
+void TrackStore::erase(size_t frame)
+{
+	if (!has(frame)) return;
+
+	size_t index = frame / TRACK_CHUNK_SIZE;
+	Chunk *c = modify(index);
+	size_t i = frame % TRACK_CHUNK_SIZE;
+	c->present[i / 64] &= ~(uint64_t(1) << (i % 64));
+	boxes--;
+
+	// empty chunks go back to the arena
+	if (--c->count == 0)
+	{
+		spare.push_back(c);
+		chunks[index] = NULL;
+	}
+
+	if (frame == last) updateLast();
+}
+
+/*
+* Removes all boxes and detaches the store from its file, the arena is kept
+*/
+void TrackStore::clear()
+{
+	for (size_t i = 0; i < chunks.size(); i++)
+		if (chunks[i]) spare.push_back(chunks[i]);
+
+	chunks.clear();
+	file = NULL;
+	file_object = 0;
+	detached.clear();
+	dirty.clear();
+	boxes = 0;
+	last = 0;
+}
+
+bool TrackStore::isEmpty() const
+{
+	return boxes == 0;
+}
+
+size_t TrackStore::size() const
+{
+	return boxes;
+}
+
+/*
+* Last frame with a box, only meaningful if the store is not empty
+*/
+size_t TrackStore::lastFrame() const
+{
+	return last;
+}
+
+/*
+* Adds all boxes to object, for the parts of the core that work on TrackedObjects
+*/
+void TrackStore::toTrackedObject(BioTracker::Core::TrackedObject &object) const
+{
+	for (size_t index = 0; index < chunkCount(); index++)
+	{
+		const Chunk *c = chunk(index);
+		if (!c) continue;
+
+		for (size_t i = 0; i < TRACK_CHUNK_SIZE; i++)
+		{
+			if (!((c->present[i / 64] >> (i % 64)) & 1)) continue;
+
+			object.add(index * TRACK_CHUNK_SIZE + i,
+				std::make_shared<FlowBox>(c->x[i], c->y[i], c->w[i], c->h[i], c->phi[i]));
+		}
+	}
+}
+
+/*
+* Replaces all boxes by those of object
+*/
+void TrackStore::fromTrackedObject(BioTracker::Core::TrackedObject &object)
+{
+	clear();
+	if (!object.getLastFrameNumber()) return;
+
+	size_t end = object.getLastFrameNumber().get();
+	for (size_t frame = 0; frame <= end; frame++)
+	{
+		if (object.hasValuesAtFrame(frame))
+			set(frame, *object.get<FlowBox>(frame));
+	}
+}
+
+/*
+* Replaces all boxes by those of object in file. Nothing is read until a frame is accessed,
+* file must stay open while the store is attached.
+*/
+void TrackStore::attach(const TrackFile *file, size_t object)
+{
+	clear();
+	this->file = file;
+	file_object = object;
+
+	for (size_t index = 0; index < chunkCount(); index++)
+	{
+		const Chunk *c = chunk(index);
+		if (c) boxes += c->count;
+	}
+	updateLast();
+}
+
+bool TrackStore::isAttachedTo(const TrackFile *file, size_t object) const
+{
+	return this->file == file && file_object == object;
+}
+
+size_t TrackStore::chunkCount() const
+{
+	return file ? std::max(chunks.size(), file->chunks(file_object)) : chunks.size();
+}
+
+/*
+* Returns the chunk of frames [index * TRACK_CHUNK_SIZE, (index + 1) * TRACK_CHUNK_SIZE), NULL if it is empty
+*/
+const TrackStore::Chunk * TrackStore::chunk(size_t index) const
+{
+	if (index < chunks.size() && chunks[index]) return chunks[index];
+	if (file && !(index < detached.size() && detached[index])) return file->chunk(file_object, index);
+	return NULL;
+}
+
+bool TrackStore::isDirty(size_t index) const
+{
+	return index < dirty.size() && dirty[index];
+}
+
+/*
+* Forgets the changes, after they were written to the file
+*/
+void TrackStore::markSaved()
+{
+	dirty.assign(dirty.size(), 0);
+}
+
+TrackStore::Chunk * TrackStore::allocate()
+{
+	if (spare.empty())
+	{
+		blocks.emplace_back(new Chunk[ARENA_BLOCK_CHUNKS]);
+		for (int i = ARENA_BLOCK_CHUNKS - 1; i >= 0; i--)
+			spare.push_back(&blocks.back()[i]);
+	}
+
+	Chunk *c = spare.back();
+	spare.pop_back();
+
+	for (size_t i = 0; i < TRACK_CHUNK_SIZE / 64; i++) c->present[i] = 0;
+	c->count = 0;
+	return c;
+}
+
+/*
+* Returns the chunk at index for changing it, a chunk of the file is copied into memory first
+*/
+TrackStore::Chunk * TrackStore::modify(size_t index)
+{
+	if (index >= chunks.size())
+	{
+		chunks.resize(index + 1, NULL);
+		detached.resize(index + 1, 0);
+		dirty.resize(index + 1, 0);
+	}
+
+	if (!chunks[index])
+	{
+		const Chunk *stored = chunk(index);
+		chunks[index] = allocate();
+		if (stored) memcpy(chunks[index], stored, sizeof(Chunk));
+	}
+
+	detached[index] = 1;
+	dirty[index] = 1;
+	return chunks[index];
+}
+
+/*
+* Finds the last frame present after it was erased
+*/
+void TrackStore::updateLast()
+{
+	last = 0;
+	for (size_t index = chunkCount(); index-- > 0; )
+	{
+		const Chunk *c = chunk(index);
+		if (!c) continue;
+
+		for (size_t i = TRACK_CHUNK_SIZE; i-- > 0; )
+		{
+			if ((c->present[i / 64] >> (i % 64)) & 1)
+			{
+				last = index * TRACK_CHUNK_SIZE + i;
+				return;
+			}
+		}
+	}
+}
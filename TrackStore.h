@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <biotracker/serialization/TrackedObject.h>
+
+#include "FlowBox.h"
+
+#define TRACK_CHUNK_SIZE 256 // frames per chunk, a multiple of 64
+
+class TrackFile;
+
+/*
+* Boxes of one tracked object by frame, stored column by column.
+* Frames are grouped in chunks with one presence bit per frame. Chunks come from an arena that
+* grows in blocks and takes back chunks that became empty, so there is no heap object per box.
+* Access by frame is O(1).
+* A store can be attached to an object of a TrackFile, its chunks are then read from the mapped
+* file until they are changed.
+*/
+class TrackStore
+{
+public:
+	/*
+	* Boxes of TRACK_CHUNK_SIZE frames, also the record of a chunk in a TrackFile
+	*/
+	struct Chunk
+	{
+		float x[TRACK_CHUNK_SIZE];
+		float y[TRACK_CHUNK_SIZE];
+		float w[TRACK_CHUNK_SIZE];
+		float h[TRACK_CHUNK_SIZE];
+		float phi[TRACK_CHUNK_SIZE];
+		uint64_t present[TRACK_CHUNK_SIZE / 64];
+		int32_t count; // frames present
+		int32_t reserved;
+	};
+
+private:
+	std::vector<Chunk*> chunks; // by frame / TRACK_CHUNK_SIZE, NULL while empty or in the file
+	std::vector<std::unique_ptr<Chunk[]> > blocks; // the arena
+	std::vector<Chunk*> spare; // chunks of the arena not in use
+	const TrackFile *file; // not owned
+	size_t file_object; // index of the object in file
+	std::vector<char> detached; // by chunk, the chunk is no longer read from the file
+	std::vector<char> dirty; // by chunk, changed since the last save
+	size_t boxes; // frames present
+	size_t last; // last frame present
+
+public:
+	TrackStore();
+	bool has(size_t frame) const;
+	FlowBox get(size_t frame) const;
+	void set(size_t frame, const FlowBox &bb);
+	void erase(size_t frame);
+	void clear();
+	bool isEmpty() const;
+	size_t size() const;
+	size_t lastFrame() const;
+	void toTrackedObject(BioTracker::Core::TrackedObject &object) const;
+	void fromTrackedObject(BioTracker::Core::TrackedObject &object);
+
+	void attach(const TrackFile *file, size_t object);
+	bool isAttachedTo(const TrackFile *file, size_t object) const;
+	size_t chunkCount() const;
+	const Chunk * chunk(size_t index) const;
+	bool isDirty(size_t index) const;
+	void markSaved();
+
+private:
+	Chunk * allocate();
+	Chunk * modify(size_t index);
+	void updateLast();
+};